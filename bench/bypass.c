@@ -0,0 +1,158 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Fullscreen bypass benchmark for a running calavera-wm built with the
+ * compositor, see bypass.sh.
+ *
+ * Maps a fullscreen window with _NET_WM_BYPASS_COMPOSITOR set to the given
+ * value (1 asks for the bypass, 2 to stay composited) and repaints all of
+ * it at a fixed rate, the way a game or a video player does. Every frame
+ * ends with a round trip, so the frame times include the server's work
+ * for the compositor. Prints the frame pacing and the CPU time the WM and
+ * the X server used per second.
+ *
+ * usage: bypass -p wmpid [-x serverpid] [-b 0|1|2] [-s seconds] [-r fps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+
+static Display *dpy;
+
+static void die(const char *msg) {
+    fprintf(stderr, "bypass: %s\n", msg);
+    exit(2);
+}
+
+static long long now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* user and system time of a process in ms, -1 if unknown */
+static long cputime(pid_t pid) {
+    char path[64], buf[1024], *p;
+    unsigned long utime, stime;
+    FILE *f;
+    size_t n;
+
+    if(!pid)
+        return -1;
+    snprintf(path, sizeof path, "/proc/%d/stat", (int)pid);
+    if(!(f = fopen(path, "r")))
+        die("process is gone");
+    n = fread(buf, 1, sizeof buf - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    /* the fields after the command name, which may contain spaces */
+    if(!(p = strrchr(buf, ')'))
+       || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+        return -1;
+    return (utime + stime) * 1000 / sysconf(_SC_CLK_TCK);
+}
+
+static int cmp(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+    int c, i, n, sw, sh, seconds = 10, fps = 60, missed = 0;
+    long bypass = 1, wm0, x0, wm1, x1;
+    long long period, start, next, t, *frame;
+    double avg = 0;
+    pid_t wmpid = 0, xpid = 0;
+    Window root, w;
+    GC gc;
+    XEvent ev;
+    Atom netwmstate, netfullscreen;
+    unsigned long colors[2];
+
+    while((c = getopt(argc, argv, "p:x:b:s:r:")) != -1) {
+        switch(c) {
+        case 'p': wmpid = atoi(optarg); break;
+        case 'x': xpid = atoi(optarg); break;
+        case 'b': bypass = atol(optarg); break;
+        case 's': seconds = atoi(optarg); break;
+        case 'r': fps = atoi(optarg); break;
+        default: die("usage: bypass -p wmpid [-x serverpid] [-b 0|1|2] [-s seconds] [-r fps]");
+        }
+    }
+    if(!wmpid || seconds < 1 || fps < 1)
+        die("usage: bypass -p wmpid [-x serverpid] [-b 0|1|2] [-s seconds] [-r fps]");
+    if(!(dpy = XOpenDisplay(NULL)))
+        die("cannot open display");
+    n = seconds * fps;
+    if(!(frame = calloc(n, sizeof *frame)))
+        die("out of memory");
+    root = DefaultRootWindow(dpy);
+    sw = DisplayWidth(dpy, DefaultScreen(dpy));
+    sh = DisplayHeight(dpy, DefaultScreen(dpy));
+    netwmstate = XInternAtom(dpy, "_NET_WM_STATE", False);
+    netfullscreen = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
+    colors[0] = BlackPixel(dpy, DefaultScreen(dpy));
+    colors[1] = WhitePixel(dpy, DefaultScreen(dpy));
+
+    w = XCreateSimpleWindow(dpy, root, 0, 0, sw / 2, sh / 2, 0, 0, 0);
+    XSelectInput(dpy, w, StructureNotifyMask);
+    XStoreName(dpy, w, "bypass");
+    XChangeProperty(dpy, w, XInternAtom(dpy, "_NET_WM_BYPASS_COMPOSITOR", False), XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *)&bypass, 1);
+    XMapWindow(dpy, w);
+    do
+        XWindowEvent(dpy, w, StructureNotifyMask, &ev);
+    while(ev.type != MapNotify);
+    memset(&ev, 0, sizeof ev);
+    ev.xclient.type = ClientMessage;
+    ev.xclient.window = w;
+    ev.xclient.message_type = netwmstate;
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = 1; /* _NET_WM_STATE_ADD */
+    ev.xclient.data.l[1] = netfullscreen;
+    XSendEvent(dpy, root, False, SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+    do
+        XWindowEvent(dpy, w, StructureNotifyMask, &ev);
+    while(ev.type != ConfigureNotify || ev.xconfigure.width != sw || ev.xconfigure.height != sh);
+    gc = XCreateGC(dpy, w, 0, NULL);
+    sleep(1); /* let the WM settle */
+
+    period = 1000000 / fps;
+    wm0 = cputime(wmpid);
+    x0 = cputime(xpid);
+    for(i = 0, start = next = now_us(); i < n; i++) {
+        t = now_us();
+        XSetForeground(dpy, gc, colors[i % 2]);
+        XFillRectangle(dpy, w, gc, 0, 0, sw, sh);
+        XSync(dpy, False);
+        frame[i] = now_us() - t;
+        if(frame[i] > period)
+            missed++;
+        avg += frame[i];
+        if((next += period) > (t = now_us()))
+            usleep(next - t);
+        else
+            next = t;
+    }
+    t = now_us() - start;
+    wm1 = cputime(wmpid);
+    x1 = cputime(xpid);
+
+    qsort(frame, n, sizeof *frame, cmp);
+    printf("bypass=%ld frames=%d time avg=%.0fus p50=%lldus p99=%lldus max=%lldus missed=%d\n",
+           bypass, n, avg / n, frame[n / 2], frame[n * 99 / 100], frame[n - 1], missed);
+    printf("bypass=%ld cpu wm=%.1fms/s", bypass, (wm1 - wm0) * 1e6 / t);
+    if(x0 >= 0)
+        printf(" server=%.1fms/s", (x1 - x0) * 1e6 / t);
+    printf("\n");
+    free(frame);
+    XCloseDisplay(dpy);
+    return 0;
+}
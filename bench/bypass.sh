@@ -0,0 +1,29 @@
+#!/bin/sh
+# Fullscreen bypass benchmark: runs calavera-wm on a private Xvfb and measures
+# a fullscreen client with the bypass refused, then asked for.
+# usage: bench/bypass.sh [seconds]   (run from the source directory after make bypass,
+#                                     with COMPFLAGS and COMPLIBS uncommented)
+
+DPY=:${BYPASS_DISPLAY:-98}
+RUNTIME=${1:-10}
+
+HOME=$(mktemp -d) || exit 2
+export HOME
+
+Xvfb "$DPY" -screen 0 1920x1080x24 -nolisten tcp >/dev/null 2>&1 &
+XVFB=$!
+sleep 1
+DISPLAY=$DPY ./calavera-wm 2>bypass-wm.log &
+WM=$!
+sleep 1
+
+STATUS=0
+for b in 2 1; do
+    DISPLAY=$DPY bench/bypass -p "$WM" -x "$XVFB" -b $b -s "$RUNTIME" || STATUS=$?
+done
+
+kill -USR1 "$WM"
+sleep 1
+kill "$WM" "$XVFB"
+rm -rf "$HOME"
+exit $STATUS
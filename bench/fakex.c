@@ -0,0 +1,1286 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Fake Xlib for bench/sim: the calls calavera-wm makes, answered from an
+ * in-process window tree instead of an X server.
+ *
+ * There is a single display, the WM's. Requests are numbered the way Xlib
+ * does and the ones that wait for a reply are counted as round trips too.
+ * Replies come from the tree, and the events a server would send the WM
+ * for what it selected are queued at once: structure notifications (for
+ * clients twice, on the window and on the root), property and focus
+ * changes, plus the map and configure requests and key presses of the
+ * clients driven through fakex.h. Nothing is drawn and there is no
+ * pointer, so there are no crossing or motion events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/Xproto.h>
+#include <X11/Xutil.h>
+
+#include "fakex.h"
+
+#define SCREEN_W 1920
+#define SCREEN_H 1080
+#define IDBITS   20 /* window ids are a generation above the slot index */
+#define SLOT(W)  ((int)((W) & ((1 << IDBITS) - 1)))
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+
+typedef struct Prop Prop;
+struct Prop {
+    Atom name, type;
+    int format, n;      /* n elements, format 32 ones are longs like in Xlib */
+    unsigned char *data;
+    Prop *next;
+};
+
+typedef struct {
+    Window id;          /* None if the slot is free */
+    Window parent;
+    int x, y, w, h, bw;
+    Bool mapped, override;
+    long mask;          /* events the WM selected */
+    Prop *props;
+    int above, below;   /* stacking among the root's children, -1 at the ends */
+} Win;
+
+static const char *predefined[XA_LAST_PREDEFINED] = {
+    "PRIMARY", "SECONDARY", "ARC", "ATOM", "BITMAP", "CARDINAL", "COLORMAP", "CURSOR",
+    "CUT_BUFFER0", "CUT_BUFFER1", "CUT_BUFFER2", "CUT_BUFFER3", "CUT_BUFFER4",
+    "CUT_BUFFER5", "CUT_BUFFER6", "CUT_BUFFER7", "DRAWABLE", "FONT", "INTEGER", "PIXMAP",
+    "POINT", "RECTANGLE", "RESOURCE_MANAGER", "RGB_COLOR_MAP", "RGB_BEST_MAP",
+    "RGB_BLUE_MAP", "RGB_DEFAULT_MAP", "RGB_GRAY_MAP", "RGB_GREEN_MAP", "RGB_RED_MAP",
+    "STRING", "VISUALID", "WINDOW", "WM_COMMAND", "WM_HINTS", "WM_CLIENT_MACHINE",
+    "WM_ICON_NAME", "WM_ICON_SIZE", "WM_NAME", "WM_NORMAL_HINTS", "WM_SIZE_HINTS",
+    "WM_ZOOM_HINTS", "MIN_SPACE", "NORM_SPACE", "MAX_SPACE", "END_SPACE", "SUPERSCRIPT_X",
+    "SUPERSCRIPT_Y", "SUBSCRIPT_X", "SUBSCRIPT_Y", "UNDERLINE_POSITION",
+    "UNDERLINE_THICKNESS", "STRIKEOUT_ASCENT", "STRIKEOUT_DESCENT", "ITALIC_ANGLE",
+    "X_HEIGHT", "QUAD_WIDTH", "WEIGHT", "POINT_SIZE", "RESOLUTION", "COPYRIGHT", "NOTICE",
+    "FONT_NAME", "FAMILY_NAME", "FULL_NAME", "CAP_HEIGHT", "WM_CLASS", "WM_TRANSIENT_FOR",
+};
+
+static struct {
+    _XPrivDisplay d;
+    Screen screen;
+    Visual visual;
+    int pipe[2];        /* never readable, stands in for the connection */
+    Win *wins;          /* slot 0 is the root */
+    int nwins, maxwins;
+    int freewin;        /* free slots, chained through above */
+    int top, bottom;    /* the root's children */
+    unsigned int gen;
+    XID nextid;         /* pixmaps, cursors, fonts */
+    XEvent *queue;
+    int qhead, qlen, qmax;
+    char **atoms;       /* atom i + 1 */
+    int natoms, maxatoms;
+    KeySym keymap[256];
+    Window focus;
+    int px, py;         /* pointer */
+    XErrorHandler handler;
+    FakeXCounters k;
+} fx;
+
+static void *xalloc(size_t size) {
+    void *p;
+
+    if(!(p = calloc(1, size))) {
+        fprintf(stderr, "fakex: out of memory\n");
+        exit(2);
+    }
+    return p;
+}
+
+static void *xrealloc(void *p, size_t size) {
+    if(!(p = realloc(p, size))) {
+        fprintf(stderr, "fakex: out of memory\n");
+        exit(2);
+    }
+    return p;
+}
+
+static int defaulthandler(Display *dpy, XErrorEvent *ee) {
+    fprintf(stderr, "fakex: error %d on request %d\n", ee->error_code, ee->request_code);
+    return 0;
+}
+
+static void request(void) {
+    fx.d->request++;
+    fx.k.requests++;
+}
+
+static void reply(void) {
+    request();
+    fx.k.roundtrips++;
+    fx.d->last_request_read = fx.d->request;
+}
+
+static void error(unsigned char code, XID id, unsigned char opcode) {
+    XErrorEvent ee;
+
+    fx.k.errors++;
+    memset(&ee, 0, sizeof ee);
+    ee.display = (Display *)fx.d;
+    ee.resourceid = id;
+    ee.serial = fx.d->request;
+    ee.error_code = code;
+    ee.request_code = opcode;
+    fx.handler((Display *)fx.d, &ee);
+}
+
+static Win *lookup(Window w) {
+    int i = SLOT(w);
+
+    return w && i < fx.nwins && fx.wins[i].id == w ? &fx.wins[i] : NULL;
+}
+
+/* the window of a request, a BadWindow error if it is gone */
+static Win *target(Window w, unsigned char opcode) {
+    Win *p;
+
+    if(!(p = lookup(w)))
+        error(BadWindow, w, opcode);
+    return p;
+}
+
+static XEvent *push(int type, Window window) {
+    XEvent *ev;
+
+    if(fx.qhead + fx.qlen == fx.qmax) {
+        if(fx.qhead > fx.qmax / 2) {
+            memmove(fx.queue, fx.queue + fx.qhead, fx.qlen * sizeof *fx.queue);
+            fx.qhead = 0;
+        }
+        else {
+            fx.qmax = fx.qmax ? fx.qmax * 2 : 256;
+            fx.queue = xrealloc(fx.queue, fx.qmax * sizeof *fx.queue);
+        }
+    }
+    ev = &fx.queue[fx.qhead + fx.qlen++];
+    memset(ev, 0, sizeof *ev);
+    ev->type = type;
+    ev->xany.serial = fx.d->request;
+    ev->xany.display = (Display *)fx.d;
+    ev->xany.window = window;
+    fx.d->qlen = fx.qlen;
+    fx.k.events++;
+    return ev;
+}
+
+static void pop(int i, XEvent *ev) {
+    *ev = fx.queue[fx.qhead + i];
+    if(i == 0)
+        fx.qhead++;
+    else
+        memmove(&fx.queue[fx.qhead + i], &fx.queue[fx.qhead + i + 1],
+                (fx.qlen - i - 1) * sizeof *fx.queue);
+    if(!--fx.qlen)
+        fx.qhead = 0;
+    fx.d->qlen = fx.qlen;
+}
+
+/* a structure event to whoever selected it on the window and on its parent */
+static void notify(Win *w, XEvent *ev) {
+    Win *parent = lookup(w->parent);
+    XEvent *copy;
+
+    if(w->mask & StructureNotifyMask) {
+        copy = push(ev->type, w->id);
+        *copy = *ev;
+        copy->xany.window = w->id;
+    }
+    if(parent && (parent->mask & SubstructureNotifyMask)) {
+        copy = push(ev->type, parent->id);
+        *copy = *ev;
+        copy->xany.window = parent->id;
+    }
+}
+
+static void stackunlink(int i) {
+    Win *w = &fx.wins[i];
+
+    if(w->above >= 0)
+        fx.wins[w->above].below = w->below;
+    else
+        fx.top = w->below;
+    if(w->below >= 0)
+        fx.wins[w->below].above = w->above;
+    else
+        fx.bottom = w->above;
+}
+
+static void stacktop(int i) {
+    Win *w = &fx.wins[i];
+
+    w->above = -1;
+    w->below = fx.top;
+    if(fx.top >= 0)
+        fx.wins[fx.top].above = i;
+    else
+        fx.bottom = i;
+    fx.top = i;
+}
+
+/* i right below sib */
+static void stackbelow(int i, int sib) {
+    Win *w = &fx.wins[i];
+
+    w->above = sib;
+    w->below = fx.wins[sib].below;
+    if(w->below >= 0)
+        fx.wins[w->below].above = i;
+    else
+        fx.bottom = i;
+    fx.wins[sib].below = i;
+}
+
+static Prop *findprop(Win *w, Atom name) {
+    Prop *p;
+
+    for(p = w->props; p && p->name != name; p = p->next);
+    return p;
+}
+
+static size_t elemsize(int format) {
+    return format == 32 ? sizeof(long) : format == 16 ? sizeof(short) : 1;
+}
+
+static void setprop(Win *w, Atom name, Atom type, int format, int mode,
+                    const unsigned char *data, int n) {
+    Prop *p;
+    size_t size = elemsize(format);
+    unsigned char *buf;
+
+    if(!(p = findprop(w, name))) {
+        p = xalloc(sizeof *p);
+        p->name = name;
+        p->next = w->props;
+        w->props = p;
+        mode = PropModeReplace;
+    }
+    if(mode == PropModeReplace || p->format != format) {
+        free(p->data);
+        p->data = NULL;
+        p->n = 0;
+    }
+    buf = xalloc((p->n + n) * size + 1); /* Xlib terminates format 8 data */
+    if(mode == PropModePrepend) {
+        memcpy(buf, data, n * size);
+        memcpy(buf + n * size, p->data, p->n * size);
+    }
+    else {
+        memcpy(buf, p->data, p->n * size);
+        memcpy(buf + p->n * size, data, n * size);
+    }
+    free(p->data);
+    p->data = buf;
+    p->n += n;
+    p->type = type;
+    p->format = format;
+}
+
+static void delprop(Win *w, Atom name) {
+    Prop **pp, *p;
+
+    for(pp = &w->props; *pp && (*pp)->name != name; pp = &(*pp)->next);
+    if(!(p = *pp))
+        return;
+    *pp = p->next;
+    free(p->data);
+    free(p);
+}
+
+static void propertynotify(Win *w, Atom name, int state) {
+    XEvent *ev;
+
+    if(!(w->mask & PropertyChangeMask))
+        return;
+    ev = push(PropertyNotify, w->id);
+    ev->xproperty.atom = name;
+    ev->xproperty.state = state;
+}
+
+static Win *newwin(Window parent, int x, int y, int w, int h, int bw) {
+    int i;
+    Win *p;
+    XEvent *ev;
+
+    if(fx.freewin >= 0) {
+        i = fx.freewin;
+        fx.freewin = fx.wins[i].above;
+    }
+    else {
+        if(fx.nwins == fx.maxwins) {
+            fx.maxwins = fx.maxwins ? fx.maxwins * 2 : 64;
+            fx.wins = xrealloc(fx.wins, fx.maxwins * sizeof *fx.wins);
+        }
+        i = fx.nwins++;
+    }
+    p = &fx.wins[i];
+    memset(p, 0, sizeof *p);
+    p->id = (Window)(++fx.gen % 255 + 1) << IDBITS | i;
+    p->parent = parent;
+    p->x = x;
+    p->y = y;
+    p->w = w;
+    p->h = h;
+    p->bw = bw;
+    p->above = p->below = -1;
+    if(parent == fx.wins[0].id) {
+        stacktop(i);
+        if(fx.wins[0].mask & SubstructureNotifyMask) {
+            ev = push(CreateNotify, parent);
+            ev->xcreatewindow.window = p->id;
+            ev->xcreatewindow.x = x;
+            ev->xcreatewindow.y = y;
+            ev->xcreatewindow.width = w;
+            ev->xcreatewindow.height = h;
+        }
+    }
+    return p;
+}
+
+static void mapwin(Win *w) {
+    XEvent ev;
+
+    if(w->mapped)
+        return;
+    w->mapped = True;
+    memset(&ev, 0, sizeof ev);
+    ev.type = MapNotify;
+    ev.xmap.window = w->id;
+    ev.xmap.override_redirect = w->override;
+    notify(w, &ev);
+}
+
+static void unmapwin(Win *w) {
+    XEvent ev;
+
+    if(!w->mapped)
+        return;
+    w->mapped = False;
+    memset(&ev, 0, sizeof ev);
+    ev.type = UnmapNotify;
+    ev.xunmap.window = w->id;
+    notify(w, &ev);
+    if(fx.focus == w->id)
+        fx.focus = PointerRoot;
+}
+
+static void configurewin(Win *w) {
+    XEvent ev;
+
+    memset(&ev, 0, sizeof ev);
+    ev.type = ConfigureNotify;
+    ev.xconfigure.window = w->id;
+    ev.xconfigure.x = w->x;
+    ev.xconfigure.y = w->y;
+    ev.xconfigure.width = w->w;
+    ev.xconfigure.height = w->h;
+    ev.xconfigure.border_width = w->bw;
+    ev.xconfigure.above = w->below >= 0 ? fx.wins[w->below].id : None;
+    ev.xconfigure.override_redirect = w->override;
+    notify(w, &ev);
+}
+
+static void destroywin(Win *w) {
+    int i = w - fx.wins;
+    Prop *p;
+    XEvent ev;
+
+    unmapwin(w);
+    memset(&ev, 0, sizeof ev);
+    ev.type = DestroyNotify;
+    ev.xdestroywindow.window = w->id;
+    notify(w, &ev);
+    while((p = w->props)) {
+        w->props = p->next;
+        free(p->data);
+        free(p);
+    }
+    if(w->parent == fx.wins[0].id)
+        stackunlink(i);
+    w->id = None;
+    w->above = fx.freewin;
+    fx.freewin = i;
+}
+
+static Atom atom(const char *name, Bool create) {
+    int i;
+
+    for(i = 0; i < fx.natoms; i++)
+        if(!strcmp(fx.atoms[i], name))
+            return i + 1;
+    if(!create)
+        return None;
+    if(fx.natoms == fx.maxatoms) {
+        fx.maxatoms = fx.maxatoms ? fx.maxatoms * 2 : 128;
+        fx.atoms = xrealloc(fx.atoms, fx.maxatoms * sizeof *fx.atoms);
+    }
+    fx.atoms[fx.natoms] = strdup(name);
+    return ++fx.natoms;
+}
+
+static KeyCode keycode(KeySym keysym) {
+    int i;
+
+    for(i = 8; i < 256 && fx.keymap[i] && fx.keymap[i] != keysym; i++);
+    if(i == 256)
+        return 0;
+    fx.keymap[i] = keysym;
+    return i;
+}
+
+/* the event masks an event type is selected with */
+static long typemask(int type) {
+    switch(type) {
+    case KeyPress:         return KeyPressMask;
+    case KeyRelease:       return KeyReleaseMask;
+    case ButtonPress:      return ButtonPressMask;
+    case ButtonRelease:    return ButtonReleaseMask;
+    case MotionNotify:     return PointerMotionMask|ButtonMotionMask;
+    case EnterNotify:      return EnterWindowMask;
+    case LeaveNotify:      return LeaveWindowMask;
+    case FocusIn:
+    case FocusOut:         return FocusChangeMask;
+    case Expose:           return ExposureMask;
+    case PropertyNotify:   return PropertyChangeMask;
+    case MapRequest:
+    case ConfigureRequest: return SubstructureRedirectMask;
+    case CreateNotify:
+    case MapNotify:
+    case UnmapNotify:
+    case DestroyNotify:
+    case ConfigureNotify:  return StructureNotifyMask|SubstructureNotifyMask;
+    }
+    return 0;
+}
+
+/* the clients, see fakex.h */
+
+Window fakex_create(Display *dpy, int x, int y, int w, int h,
+                    const char *instance, const char *class, const char *title) {
+    char buf[512];
+    int n;
+    Win *p = newwin(fx.wins[0].id, x, y, w, h, 0);
+
+    n = snprintf(buf, sizeof buf, "%s%c%s", instance, '\0', class) + 1;
+    setprop(p, XA_WM_CLASS, XA_STRING, 8, PropModeReplace, (unsigned char *)buf, n);
+    setprop(p, XA_WM_NAME, XA_STRING, 8, PropModeReplace, (const unsigned char *)title, strlen(title));
+    return p->id;
+}
+
+void fakex_map(Display *dpy, Window w) {
+    Win *p = lookup(w);
+    XEvent *ev;
+
+    if(!p || p->mapped)
+        return;
+    if(!p->override && (fx.wins[0].mask & SubstructureRedirectMask)) {
+        ev = push(MapRequest, fx.wins[0].id);
+        ev->xmaprequest.window = w;
+    }
+    else
+        mapwin(p);
+}
+
+void fakex_configure(Display *dpy, Window w, int x, int y, int width, int height) {
+    Win *p = lookup(w);
+    XEvent *ev;
+
+    if(!p)
+        return;
+    if(!p->override && (fx.wins[0].mask & SubstructureRedirectMask)) {
+        ev = push(ConfigureRequest, fx.wins[0].id);
+        ev->xconfigurerequest.window = w;
+        ev->xconfigurerequest.x = x;
+        ev->xconfigurerequest.y = y;
+        ev->xconfigurerequest.width = width;
+        ev->xconfigurerequest.height = height;
+        ev->xconfigurerequest.border_width = p->bw;
+        ev->xconfigurerequest.detail = Above;
+        ev->xconfigurerequest.value_mask = CWX|CWY|CWWidth|CWHeight;
+    }
+    else {
+        p->x = x;
+        p->y = y;
+        p->w = width;
+        p->h = height;
+        configurewin(p);
+    }
+}
+
+void fakex_settitle(Display *dpy, Window w, const char *title) {
+    Win *p = lookup(w);
+
+    if(!p)
+        return;
+    setprop(p, XA_WM_NAME, XA_STRING, 8, PropModeReplace, (const unsigned char *)title, strlen(title));
+    propertynotify(p, XA_WM_NAME, PropertyNewValue);
+}
+
+void fakex_destroy(Display *dpy, Window w) {
+    Win *p = lookup(w);
+
+    if(p)
+        destroywin(p);
+}
+
+void fakex_key(Display *dpy, unsigned int state, KeySym keysym) {
+    XEvent *ev = push(KeyPress, fx.wins[0].id);
+
+    ev->xkey.root = fx.wins[0].id;
+    ev->xkey.state = state;
+    ev->xkey.keycode = keycode(keysym);
+    ev->xkey.same_screen = True;
+}
+
+void fakex_counters(Display *dpy, FakeXCounters *k) {
+    *k = fx.k;
+}
+
+/* the connection */
+
+Display *XOpenDisplay(const char *name) {
+    int i;
+    Win *root;
+
+    memset(&fx, 0, sizeof fx);
+    fx.d = xalloc(sizeof *fx.d);
+    if(pipe(fx.pipe) < 0) {
+        free(fx.d);
+        return NULL;
+    }
+    fx.freewin = fx.top = fx.bottom = -1;
+    fx.handler = defaulthandler;
+    fx.nextid = 0x400000;
+    for(i = 0; i < XA_LAST_PREDEFINED; i++)
+        atom(predefined[i], True);
+    root = newwin(None, 0, 0, SCREEN_W, SCREEN_H, 0);
+    root->mapped = True;
+    fx.focus = PointerRoot;
+    fx.screen.display = (Display *)fx.d;
+    fx.screen.root = root->id;
+    fx.screen.width = SCREEN_W;
+    fx.screen.height = SCREEN_H;
+    fx.screen.mwidth = SCREEN_W / 4;
+    fx.screen.mheight = SCREEN_H / 4;
+    fx.screen.root_depth = 24;
+    fx.screen.root_visual = &fx.visual;
+    fx.screen.cmap = fx.nextid++;
+    fx.screen.white_pixel = 0xffffff;
+    fx.screen.black_pixel = 0;
+    fx.d->fd = fx.pipe[0];
+    fx.d->proto_major_version = 11;
+    fx.d->display_name = ":sim";
+    fx.d->default_screen = 0;
+    fx.d->nscreens = 1;
+    fx.d->screens = &fx.screen;
+    return (Display *)fx.d;
+}
+
+int XCloseDisplay(Display *dpy) {
+    int i;
+    Prop *p;
+
+    for(i = 0; i < fx.nwins; i++)
+        while(fx.wins[i].id && (p = fx.wins[i].props)) {
+            fx.wins[i].props = p->next;
+            free(p->data);
+            free(p);
+        }
+    for(i = 0; i < fx.natoms; i++)
+        free(fx.atoms[i]);
+    free(fx.atoms);
+    free(fx.wins);
+    free(fx.queue);
+    close(fx.pipe[0]);
+    close(fx.pipe[1]);
+    free(fx.d);
+    memset(&fx, 0, sizeof fx);
+    return 0;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler) {
+    XErrorHandler old = fx.handler;
+
+    fx.handler = handler ? handler : defaulthandler;
+    return old;
+}
+
+int XFree(void *data) {
+    free(data);
+    return 1;
+}
+
+int XFlush(Display *dpy) {
+    return 1;
+}
+
+int XSync(Display *dpy, Bool discard) {
+    reply();
+    if(discard) {
+        fx.qhead = fx.qlen = 0;
+        fx.d->qlen = 0;
+    }
+    return 1;
+}
+
+/* events */
+
+int XPending(Display *dpy) {
+    return fx.qlen;
+}
+
+int XNextEvent(Display *dpy, XEvent *ev) {
+    if(!fx.qlen) {
+        fprintf(stderr, "fakex: XNextEvent() would block forever\n");
+        exit(2);
+    }
+    pop(0, ev);
+    return 0;
+}
+
+Bool XCheckIfEvent(Display *dpy, XEvent *ev, Bool (*pred)(Display *, XEvent *, XPointer), XPointer arg) {
+    int i;
+
+    for(i = 0; i < fx.qlen; i++)
+        if(pred(dpy, &fx.queue[fx.qhead + i], arg)) {
+            pop(i, ev);
+            return True;
+        }
+    return False;
+}
+
+Bool XCheckMaskEvent(Display *dpy, long mask, XEvent *ev) {
+    int i;
+
+    for(i = 0; i < fx.qlen; i++)
+        if(typemask(fx.queue[fx.qhead + i].type) & mask) {
+            pop(i, ev);
+            return True;
+        }
+    return False;
+}
+
+Bool XCheckTypedEvent(Display *dpy, int type, XEvent *ev) {
+    int i;
+
+    for(i = 0; i < fx.qlen; i++)
+        if(fx.queue[fx.qhead + i].type == type) {
+            pop(i, ev);
+            return True;
+        }
+    return False;
+}
+
+Status XSendEvent(Display *dpy, Window w, Bool propagate, long mask, XEvent *ev) {
+    request();
+    return 1;
+}
+
+int XSelectInput(Display *dpy, Window w, long mask) {
+    Win *p;
+
+    request();
+    if((p = target(w, X_ChangeWindowAttributes)))
+        p->mask = mask;
+    return 1;
+}
+
+/* windows */
+
+Window XCreateWindow(Display *dpy, Window parent, int x, int y, unsigned int w, unsigned int h,
+                     unsigned int bw, int depth, unsigned int class, Visual *visual,
+                     unsigned long valuemask, XSetWindowAttributes *wa) {
+    Win *p;
+
+    request();
+    p = newwin(parent, x, y, w, h, bw);
+    if(valuemask & CWOverrideRedirect)
+        p->override = wa->override_redirect;
+    if(valuemask & CWEventMask)
+        p->mask = wa->event_mask;
+    return p->id;
+}
+
+int XDestroyWindow(Display *dpy, Window w) {
+    Win *p;
+
+    request();
+    if((p = target(w, X_DestroyWindow)))
+        destroywin(p);
+    return 1;
+}
+
+int XChangeWindowAttributes(Display *dpy, Window w, unsigned long valuemask, XSetWindowAttributes *wa) {
+    Win *p;
+
+    request();
+    if(!(p = target(w, X_ChangeWindowAttributes)))
+        return 1;
+    if(valuemask & CWOverrideRedirect)
+        p->override = wa->override_redirect;
+    if(valuemask & CWEventMask)
+        p->mask = wa->event_mask;
+    return 1;
+}
+
+Status XGetWindowAttributes(Display *dpy, Window w, XWindowAttributes *wa) {
+    Win *p;
+
+    reply();
+    if(!(p = target(w, X_GetWindowAttributes)))
+        return 0;
+    memset(wa, 0, sizeof *wa);
+    wa->x = p->x;
+    wa->y = p->y;
+    wa->width = p->w;
+    wa->height = p->h;
+    wa->border_width = p->bw;
+    wa->depth = 24;
+    wa->visual = &fx.visual;
+    wa->root = fx.wins[0].id;
+    wa->class = InputOutput;
+    wa->colormap = fx.screen.cmap;
+    wa->map_state = p->mapped ? IsViewable : IsUnmapped;
+    wa->all_event_masks = wa->your_event_mask = p->mask;
+    wa->override_redirect = p->override;
+    wa->screen = &fx.screen;
+    return 1;
+}
+
+Status XQueryTree(Display *dpy, Window w, Window *root, Window *parent, Window **children,
+                  unsigned int *n) {
+    int i;
+    Win *p;
+
+    reply();
+    *children = NULL;
+    *n = 0;
+    if(!(p = target(w, X_QueryTree)))
+        return 0;
+    *root = fx.wins[0].id;
+    *parent = p->parent;
+    if(w != fx.wins[0].id)
+        return 1;
+    for(i = fx.bottom; i >= 0; i = fx.wins[i].above)
+        (*n)++;
+    if(*n)
+        *children = xalloc(*n * sizeof **children);
+    for(*n = 0, i = fx.bottom; i >= 0; i = fx.wins[i].above)
+        (*children)[(*n)++] = fx.wins[i].id;
+    return 1;
+}
+
+int XMapWindow(Display *dpy, Window w) {
+    Win *p;
+
+    request();
+    if((p = target(w, X_MapWindow)))
+        mapwin(p);
+    return 1;
+}
+
+int XRaiseWindow(Display *dpy, Window w) {
+    Win *p;
+
+    request();
+    if(!(p = target(w, X_ConfigureWindow)) || p->parent != fx.wins[0].id || fx.top == SLOT(w))
+        return 1;
+    stackunlink(SLOT(w));
+    stacktop(SLOT(w));
+    configurewin(p);
+    return 1;
+}
+
+int XMapRaised(Display *dpy, Window w) {
+    Win *p;
+
+    request();
+    if(!(p = target(w, X_MapWindow)))
+        return 1;
+    if(p->parent == fx.wins[0].id && fx.top != SLOT(w)) {
+        stackunlink(SLOT(w));
+        stacktop(SLOT(w));
+    }
+    mapwin(p);
+    return 1;
+}
+
+int XUnmapWindow(Display *dpy, Window w) {
+    Win *p;
+
+    request();
+    if((p = target(w, X_UnmapWindow)))
+        unmapwin(p);
+    return 1;
+}
+
+int XConfigureWindow(Display *dpy, Window w, unsigned int mask, XWindowChanges *wc) {
+    Win *p, *s;
+
+    request();
+    if(!(p = target(w, X_ConfigureWindow)))
+        return 1;
+    if(mask & CWX)
+        p->x = wc->x;
+    if(mask & CWY)
+        p->y = wc->y;
+    if(mask & CWWidth)
+        p->w = wc->width;
+    if(mask & CWHeight)
+        p->h = wc->height;
+    if(mask & CWBorderWidth)
+        p->bw = wc->border_width;
+    /* Above on top of all and Below a sibling, what the WM uses */
+    if((mask & CWStackMode) && p->parent == fx.wins[0].id) {
+        if(!(mask & CWSibling) && wc->stack_mode == Above && fx.top != SLOT(w)) {
+            stackunlink(SLOT(w));
+            stacktop(SLOT(w));
+        }
+        else if((mask & CWSibling) && wc->stack_mode == Below && wc->sibling != w
+                && (s = lookup(wc->sibling)) && s->parent == p->parent && s->below != SLOT(w)) {
+            stackunlink(SLOT(w));
+            stackbelow(SLOT(w), SLOT(wc->sibling));
+        }
+    }
+    configurewin(p);
+    return 1;
+}
+
+/* like Xlib, a ConfigureWindow for each window but the first */
+int XRestackWindows(Display *dpy, Window *w, int n) {
+    XWindowChanges wc;
+    int i;
+
+    wc.stack_mode = Below;
+    for(i = 1; i < n; i++) {
+        wc.sibling = w[i - 1];
+        XConfigureWindow(dpy, w[i], CWSibling | CWStackMode, &wc);
+    }
+    return 1;
+}
+
+int XMoveResizeWindow(Display *dpy, Window w, int x, int y, unsigned int width, unsigned int height) {
+    XWindowChanges wc = { x, y, width, height, 0, None, 0 };
+
+    return XConfigureWindow(dpy, w, CWX|CWY|CWWidth|CWHeight, &wc);
+}
+
+int XMoveWindow(Display *dpy, Window w, int x, int y) {
+    XWindowChanges wc = { x, y, 0, 0, 0, None, 0 };
+
+    return XConfigureWindow(dpy, w, CWX|CWY, &wc);
+}
+
+int XSetWindowBorder(Display *dpy, Window w, unsigned long pixel) {
+    request();
+    target(w, X_ChangeWindowAttributes);
+    return 1;
+}
+
+int XKillClient(Display *dpy, XID id) {
+    Win *p;
+
+    request();
+    if((p = lookup(id)))
+        destroywin(p);
+    return 1;
+}
+
+int XSetCloseDownMode(Display *dpy, int mode) {
+    request();
+    return 1;
+}
+
+/* properties */
+
+Atom XInternAtom(Display *dpy, const char *name, Bool onlyifexists) {
+    reply();
+    return atom(name, !onlyifexists);
+}
+
+char *XGetAtomName(Display *dpy, Atom a) {
+    reply();
+    if(a < 1 || a > (Atom)fx.natoms) {
+        error(BadAtom, a, X_GetAtomName);
+        return NULL;
+    }
+    return strdup(fx.atoms[a - 1]);
+}
+
+int XChangeProperty(Display *dpy, Window w, Atom name, Atom type, int format, int mode,
+                    const unsigned char *data, int n) {
+    Win *p;
+
+    request();
+    if(!(p = target(w, X_ChangeProperty)))
+        return 1;
+    setprop(p, name, type, format, mode, data, n);
+    propertynotify(p, name, PropertyNewValue);
+    return 1;
+}
+
+int XGetWindowProperty(Display *dpy, Window w, Atom name, long offset, long length, Bool delete,
+                       Atom reqtype, Atom *type, int *format, unsigned long *n,
+                       unsigned long *after, unsigned char **data) {
+    Win *w_;
+    Prop *p;
+    size_t size;
+    long unit, first, count;
+
+    reply();
+    *type = None;
+    *format = 0;
+    *n = *after = 0;
+    *data = NULL;
+    if(!(w_ = target(w, X_GetProperty)))
+        return BadWindow;
+    if(!(p = findprop(w_, name)))
+        return Success;
+    *type = p->type;
+    *format = p->format;
+    unit = p->format / 8; /* bytes per element on the wire */
+    if(reqtype != AnyPropertyType && reqtype != p->type) {
+        *after = p->n * unit;
+        return Success;
+    }
+    size = elemsize(p->format);
+    first = MIN(offset * 4 / unit, p->n);
+    count = MIN(length * 4 / unit, p->n - first);
+    *n = count;
+    *after = (p->n - first - count) * unit;
+    *data = xalloc(count * size + 1);
+    memcpy(*data, p->data + first * size, count * size);
+    if(delete && !*after) {
+        delprop(w_, name);
+        propertynotify(w_, name, PropertyDelete);
+    }
+    return Success;
+}
+
+Status XGetTextProperty(Display *dpy, Window w, XTextProperty *tp, Atom name) {
+    Win *p;
+    Prop *prop;
+
+    reply();
+    memset(tp, 0, sizeof *tp);
+    if(!(p = target(w, X_GetProperty)) || !(prop = findprop(p, name)))
+        return 0;
+    tp->value = xalloc(prop->n * elemsize(prop->format) + 1);
+    memcpy(tp->value, prop->data, prop->n * elemsize(prop->format));
+    tp->encoding = prop->type;
+    tp->format = prop->format;
+    tp->nitems = prop->n;
+    return 1;
+}
+
+int XmbTextPropertyToTextList(Display *dpy, const XTextProperty *tp, char ***list, int *count) {
+    char **l = xalloc(sizeof *l + tp->nitems + 1);
+
+    /* one block like Xlib's, XFreeStringList() frees it at once */
+    l[0] = (char *)(l + 1);
+    memcpy(l[0], tp->value, tp->nitems);
+    *list = l;
+    *count = 1;
+    return Success;
+}
+
+void XFreeStringList(char **list) {
+    free(list);
+}
+
+Status XGetClassHint(Display *dpy, Window w, XClassHint *ch) {
+    Win *p;
+    Prop *prop;
+    size_t len;
+
+    reply();
+    ch->res_name = ch->res_class = NULL;
+    if(!(p = target(w, X_GetProperty)) || !(prop = findprop(p, XA_WM_CLASS)) || prop->format != 8)
+        return 0;
+    len = strlen((char *)prop->data);
+    ch->res_name = strdup((char *)prop->data);
+    ch->res_class = strdup(len < (size_t)prop->n ? (char *)prop->data + len + 1 : "");
+    return 1;
+}
+
+Status XGetTransientForHint(Display *dpy, Window w, Window *trans) {
+    Win *p;
+    Prop *prop;
+
+    reply();
+    *trans = None;
+    if(!(p = target(w, X_GetProperty)) || !(prop = findprop(p, XA_WM_TRANSIENT_FOR)) || prop->n < 1)
+        return 0;
+    *trans = *(Window *)prop->data;
+    return 1;
+}
+
+Status XGetWMNormalHints(Display *dpy, Window w, XSizeHints *hints, long *supplied) {
+    Win *p;
+    Prop *prop;
+    long *l;
+
+    reply();
+    *supplied = 0;
+    if(!(p = target(w, X_GetProperty)) || !(prop = findprop(p, XA_WM_NORMAL_HINTS)) || prop->n < 18)
+        return 0;
+    /* the wire layout of WM_SIZE_HINTS */
+    l = (long *)prop->data;
+    memset(hints, 0, sizeof *hints);
+    hints->flags = l[0];
+    hints->min_width = l[5];
+    hints->min_height = l[6];
+    hints->max_width = l[7];
+    hints->max_height = l[8];
+    hints->width_inc = l[9];
+    hints->height_inc = l[10];
+    hints->min_aspect.x = l[11];
+    hints->min_aspect.y = l[12];
+    hints->max_aspect.x = l[13];
+    hints->max_aspect.y = l[14];
+    hints->base_width = l[15];
+    hints->base_height = l[16];
+    hints->win_gravity = l[17];
+    *supplied = hints->flags;
+    return 1;
+}
+
+Status XGetWMProtocols(Display *dpy, Window w, Atom **protocols, int *n) {
+    Win *p;
+    Prop *prop;
+
+    reply();
+    *protocols = NULL;
+    *n = 0;
+    if(!(p = target(w, X_GetProperty)) || !(prop = findprop(p, atom("WM_PROTOCOLS", False))))
+        return 0;
+    *protocols = xalloc(prop->n * sizeof **protocols);
+    memcpy(*protocols, prop->data, prop->n * sizeof **protocols);
+    *n = prop->n;
+    return 1;
+}
+
+/* focus and grabs */
+
+int XSetInputFocus(Display *dpy, Window w, int revert, Time time) {
+    Win *old, *new;
+    XEvent *ev;
+
+    request();
+    if(w == fx.focus)
+        return 1;
+    if(w != PointerRoot && w != None && !(new = target(w, X_SetInputFocus)))
+        return 1;
+    if((old = lookup(fx.focus)) && (old->mask & FocusChangeMask)) {
+        ev = push(FocusOut, old->id);
+        ev->xfocus.mode = NotifyNormal;
+        ev->xfocus.detail = NotifyNonlinear;
+    }
+    fx.focus = w;
+    if((new = lookup(w)) && (new->mask & FocusChangeMask)) {
+        ev = push(FocusIn, new->id);
+        ev->xfocus.mode = NotifyNormal;
+        ev->xfocus.detail = NotifyNonlinear;
+    }
+    return 1;
+}
+
+int XGrabButton(Display *dpy, unsigned int button, unsigned int mods, Window w, Bool owner,
+                unsigned int mask, int pmode, int kmode, Window confine, Cursor cursor) {
+    request();
+    target(w, X_GrabButton);
+    return 1;
+}
+
+int XUngrabButton(Display *dpy, unsigned int button, unsigned int mods, Window w) {
+    request();
+    target(w, X_UngrabButton);
+    return 1;
+}
+
+int XGrabKey(Display *dpy, int keycode, unsigned int mods, Window w, Bool owner, int pmode, int kmode) {
+    request();
+    return 1;
+}
+
+int XUngrabKey(Display *dpy, int keycode, unsigned int mods, Window w) {
+    request();
+    return 1;
+}
+
+int XGrabKeyboard(Display *dpy, Window w, Bool owner, int pmode, int kmode, Time time) {
+    reply();
+    return GrabSuccess;
+}
+
+int XUngrabKeyboard(Display *dpy, Time time) {
+    request();
+    return 1;
+}
+
+int XGrabPointer(Display *dpy, Window w, Bool owner, unsigned int mask, int pmode, int kmode,
+                 Window confine, Cursor cursor, Time time) {
+    reply();
+    return GrabSuccess;
+}
+
+int XUngrabPointer(Display *dpy, Time time) {
+    request();
+    return 1;
+}
+
+int XGrabServer(Display *dpy) {
+    request();
+    return 1;
+}
+
+int XUngrabServer(Display *dpy) {
+    request();
+    return 1;
+}
+
+Bool XQueryPointer(Display *dpy, Window w, Window *root, Window *child, int *rx, int *ry,
+                   int *wx, int *wy, unsigned int *mask) {
+    reply();
+    *root = fx.wins[0].id;
+    *child = None;
+    *rx = *wx = fx.px;
+    *ry = *wy = fx.py;
+    *mask = 0;
+    return True;
+}
+
+int XWarpPointer(Display *dpy, Window src, Window dst, int sx, int sy, unsigned int sw,
+                 unsigned int sh, int x, int y) {
+    request();
+    fx.px = x;
+    fx.py = y;
+    return 1;
+}
+
+/* keyboard, Xlib answers these from its copy of the keymap */
+
+KeyCode XKeysymToKeycode(Display *dpy, KeySym keysym) {
+    return keycode(keysym);
+}
+
+KeySym XkbKeycodeToKeysym(Display *dpy, KeyCode code, int group, int level) {
+    return fx.keymap[code];
+}
+
+KeySym XStringToKeysym(const char *s) {
+    return s[0] && !s[1] ? (KeySym)s[0] : NoSymbol;
+}
+
+int XLookupString(XKeyEvent *ev, char *buf, int size, KeySym *keysym, XComposeStatus *status) {
+    if(keysym)
+        *keysym = fx.keymap[ev->keycode];
+    return 0;
+}
+
+int XRefreshKeyboardMapping(XMappingEvent *ev) {
+    return 0;
+}
+
+XModifierKeymap *XGetModifierMapping(Display *dpy) {
+    XModifierKeymap *map = xalloc(sizeof *map);
+
+    reply();
+    map->max_keypermod = 1;
+    map->modifiermap = xalloc(8);
+    return map;
+}
+
+int XFreeModifiermap(XModifierKeymap *map) {
+    free(map->modifiermap);
+    free(map);
+    return 1;
+}
+
+/* resources and drawing, only counted */
+
+Cursor XCreateFontCursor(Display *dpy, unsigned int shape) {
+    request();
+    return fx.nextid++;
+}
+
+int XFreeCursor(Display *dpy, Cursor cursor) {
+    request();
+    return 1;
+}
+
+Pixmap XCreatePixmap(Display *dpy, Drawable d, unsigned int w, unsigned int h, unsigned int depth) {
+    request();
+    return fx.nextid++;
+}
+
+int XFreePixmap(Display *dpy, Pixmap pixmap) {
+    request();
+    return 1;
+}
+
+GC XCreateGC(Display *dpy, Drawable d, unsigned long mask, XGCValues *values) {
+    request();
+    return xalloc(64); /* opaque to the WM */
+}
+
+int XFreeGC(Display *dpy, GC gc) {
+    request();
+    free(gc);
+    return 1;
+}
+
+XFontStruct *XLoadQueryFont(Display *dpy, const char *name) {
+    XFontStruct *font = xalloc(sizeof *font);
+
+    reply();
+    font->fid = fx.nextid++;
+    font->ascent = 11;
+    font->descent = 2;
+    font->max_bounds.width = 6;
+    return font;
+}
+
+int XFreeFont(Display *dpy, XFontStruct *font) {
+    request();
+    free(font);
+    return 1;
+}
+
+int XTextWidth(XFontStruct *font, const char *s, int len) {
+    return 6 * len;
+}
+
+int XSetFont(Display *dpy, GC gc, Font font) {
+    request();
+    return 1;
+}
+
+int XSetForeground(Display *dpy, GC gc, unsigned long pixel) {
+    request();
+    return 1;
+}
+
+int XFillRectangle(Display *dpy, Drawable d, GC gc, int x, int y, unsigned int w, unsigned int h) {
+    request();
+    return 1;
+}
+
+int XDrawString(Display *dpy, Drawable d, GC gc, int x, int y, const char *s, int len) {
+    request();
+    return 1;
+}
+
+int XCopyArea(Display *dpy, Drawable src, Drawable dst, GC gc, int sx, int sy, unsigned int w,
+              unsigned int h, int dx, int dy) {
+    request();
+    return 1;
+}
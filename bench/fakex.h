@@ -0,0 +1,29 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Fake Xlib for bench/sim, see fakex.c. The WM links against it instead of
+ * libX11; these are the calls that play the clients and read the counters.
+ */
+
+#ifndef FAKEX_H
+#define FAKEX_H
+
+typedef struct {
+    unsigned long requests;   /* requests the WM made, as NextRequest() counts them */
+    unsigned long roundtrips; /* of them, the ones that wait for a reply */
+    unsigned long events;     /* events queued for the WM */
+    unsigned long errors;     /* requests on windows that are gone */
+} FakeXCounters;
+
+/* a top level client window with WM_CLASS and WM_NAME, not mapped yet */
+Window fakex_create(Display *dpy, int x, int y, int w, int h,
+                    const char *instance, const char *class, const char *title);
+/* what the client asks for, the WM gets the requests and notifications */
+void fakex_map(Display *dpy, Window w);
+void fakex_configure(Display *dpy, Window w, int x, int y, int width, int height);
+void fakex_settitle(Display *dpy, Window w, const char *title);
+void fakex_destroy(Display *dpy, Window w);
+/* a key press on the root window, the WM has the keys it binds grabbed */
+void fakex_key(Display *dpy, unsigned int state, KeySym keysym);
+void fakex_counters(Display *dpy, FakeXCounters *k);
+
+#endif
@@ -0,0 +1,308 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Microbenchmarks of libcalavera.a, the WM's logic without X.
+ *
+ * Size hints are applied to a spread of requested geometries, some of them
+ * off the window area, for the kinds of clients a session has: no hints,
+ * terminals (base size and character increments), dialogs with a fixed
+ * size, video players keeping an aspect ratio, a mix of those weighted
+ * like a desktop, and tiled clients, which skip most of the work. The list
+ * operations run on 10, 100 and 1000 clients with random picks: moving a
+ * client to the front of the client list and of the focus stack (what
+ * focus() does), the switcher going back one client and view going to a
+ * window number. Snapping and clamping get random drag positions. The
+ * stacking order is computed after raising a random client, also with
+ * every tenth client a dialog of the one before, and diffed against the
+ * order before with one window raised.
+ *
+ * Prints ns per operation, the median of the repeats. Cases on a client
+ * list run the iterations divided by its length, most of them are linear
+ * in it, so a default run takes seconds.
+ *
+ * usage: micro [-n iterations] [-r repeats] [-c case]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../calavera.h"
+
+#define MAXCLIENTS 1000
+#define NGEOMS     4096 /* requested geometries, a power of two */
+
+typedef struct {
+    const char *name;
+    int nclients;
+    void (*prepare)(void);
+    void (*op)(unsigned int i);
+} Case;
+
+static Monitor mon;
+static Client clients[MAXCLIENTS];
+static int geoms[NGEOMS][4];
+static unsigned int picks[NGEOMS];
+static Client *order[MAXCLIENTS];
+static Window cur[MAXCLIENTS], want[MAXCLIENTS];
+static int ncur, work[4 * MAXCLIENTS];
+static volatile int sink;
+static unsigned long rng = 88172645463325252UL;
+
+static unsigned int rnd(unsigned int n) {
+    /* xorshift, the same numbers every run */
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng % n;
+}
+
+/* hint kinds a client gets, see hints() */
+enum { HintNone, HintTerm, HintFixed, HintAspect, HintLast };
+
+static void hints(Client *c, int kind) {
+    memset(c, 0, sizeof *c);
+    c->isfloating = True;
+    c->bw = 1;
+    c->x = 100;
+    c->y = 100;
+    c->w = 640;
+    c->h = 480;
+    switch(kind) {
+    case HintTerm:
+        c->basew = c->baseh = 4; /* padding, the minimum is one cell more */
+        c->minw = 4 + 7;
+        c->minh = 4 + 14;
+        c->incw = 7;
+        c->inch = 14;
+        break;
+    case HintFixed:
+        c->minw = c->maxw = 420;
+        c->minh = c->maxh = 180;
+        c->isfixed = True;
+        break;
+    case HintAspect:
+        c->maxa = 16.0 / 9; /* width / height and height / width */
+        c->mina = 9.0 / 16;
+        c->minw = 160;
+        c->minh = 90;
+        break;
+    }
+}
+
+static void setup(int n) {
+    int i;
+
+    memset(&mon, 0, sizeof mon);
+    ncur = n;
+    mon.mw = 1920;
+    mon.mh = 1080;
+    mon.wy = 20;
+    mon.ww = 1920;
+    mon.wh = 1060;
+    for(i = 0; i < n; i++) {
+        hints(&clients[i], HintNone);
+        attachend(&mon, &clients[i]);
+        attachstackend(&mon, &clients[i]);
+        raiseclient(&mon, &clients[i]);
+        clients[i].win = cur[i] = 1 + i;
+    }
+    mon.thesel = n ? mon.clients : NULL;
+    for(i = 0; i < NGEOMS; i++) {
+        /* one in eight partly or wholly off the window area */
+        geoms[i][0] = (int)rnd(2400) - (rnd(8) ? 0 : 400);
+        geoms[i][1] = (int)rnd(1400) - (rnd(8) ? 0 : 300);
+        geoms[i][2] = 1 + rnd(1600);
+        geoms[i][3] = 1 + rnd(1000);
+        picks[i] = n ? rnd(n) : 0;
+    }
+}
+
+static void sizehints(Client *c, unsigned int i, Bool interact) {
+    int *g = geoms[i & (NGEOMS - 1)], x = g[0], y = g[1], w = g[2], h = g[3];
+
+    sink = applysizehints(&mon, c, &x, &y, &w, &h, 0, interact);
+}
+
+static void hintsnone(unsigned int i) {
+    sizehints(&clients[HintNone], i, False);
+}
+
+static void hintsterm(unsigned int i) {
+    sizehints(&clients[HintTerm], i, False);
+}
+
+static void hintsfixed(unsigned int i) {
+    sizehints(&clients[HintFixed], i, False);
+}
+
+static void hintsaspect(unsigned int i) {
+    sizehints(&clients[HintAspect], i, False);
+}
+
+static void hintsmixed(unsigned int i) {
+    /* 6:3:1 of no hints, terminals and dialogs, an aspect client in 16 */
+    static const unsigned char kind[16] = { 0, 0, 1, 0, 2, 1, 0, 0, 1, 0, 3, 1, 0, 2, 1, 0 };
+
+    sizehints(&clients[kind[(i * 7) & 15]], i, i & 1);
+}
+
+static void hintstiled(unsigned int i) {
+    sizehints(&clients[HintLast], i, False);
+}
+
+static void hintsprepare(void) {
+    int i;
+
+    for(i = 0; i <= HintLast; i++)
+        hints(&clients[i], i < HintLast ? i : HintNone);
+    clients[HintLast].isfloating = False;
+}
+
+static void tofront(unsigned int i) {
+    Client *c = &clients[picks[i & (NGEOMS - 1)]];
+
+    detach(&mon, c);
+    attach(&mon, c);
+}
+
+static void focusstack(unsigned int i) {
+    Client *c = &clients[picks[i & (NGEOMS - 1)]];
+
+    detachstack(&mon, c);
+    attachstack(&mon, c);
+}
+
+static void switchprev(unsigned int i) {
+    mon.thesel = &clients[picks[i & (NGEOMS - 1)]];
+    sink = nextclient(&mon, -1) != NULL;
+}
+
+static void viewnth(unsigned int i) {
+    sink = nthclient(&mon, 1, picks[i & (NGEOMS - 1)] + 1) != NULL;
+}
+
+static void snap(unsigned int i) {
+    int *g = geoms[i & (NGEOMS - 1)], x = g[0], y = g[1];
+
+    snaptoarea(&mon, &clients[0], &x, &y, 16);
+    sink = x + y;
+}
+
+static void clamp(unsigned int i) {
+    int *g = geoms[i & (NGEOMS - 1)], x = g[0], y = g[1];
+
+    clamptoarea(&mon, g[2], g[3], &x, &y);
+    sink = x + y;
+}
+
+static void stack(unsigned int i) {
+    int nbelow;
+
+    raiseclient(&mon, &clients[picks[i & (NGEOMS - 1)]]);
+    sink = stackorder(&mon, order, &nbelow);
+}
+
+static void dialogs(void) {
+    int i;
+
+    for(i = 9; i < ncur; i += 10)
+        settransient(&clients[i], &clients[i - 1]);
+}
+
+static void stackdiffraise(unsigned int i) {
+    int j, k, n = 0, lo, hi;
+
+    for(j = 0, k = picks[i & (NGEOMS - 1)]; j < ncur; j++)
+        if(j != k)
+            want[n++] = cur[j];
+    want[n++] = cur[k];
+    sink = stackdiff(cur, ncur, want, n, &lo, &hi, work) + lo + hi;
+}
+
+static const Case cases[] = {
+    { "hints-none",   0,    hintsprepare, hintsnone },
+    { "hints-term",   0,    hintsprepare, hintsterm },
+    { "hints-fixed",  0,    hintsprepare, hintsfixed },
+    { "hints-aspect", 0,    hintsprepare, hintsaspect },
+    { "hints-mixed",  0,    hintsprepare, hintsmixed },
+    { "hints-tiled",  0,    hintsprepare, hintstiled },
+    { "tofront",      10,   NULL,         tofront },
+    { "tofront",      100,  NULL,         tofront },
+    { "tofront",      1000, NULL,         tofront },
+    { "focusstack",   10,   NULL,         focusstack },
+    { "focusstack",   100,  NULL,         focusstack },
+    { "focusstack",   1000, NULL,         focusstack },
+    { "switchprev",   10,   NULL,         switchprev },
+    { "switchprev",   100,  NULL,         switchprev },
+    { "switchprev",   1000, NULL,         switchprev },
+    { "viewnth",      10,   NULL,         viewnth },
+    { "viewnth",      100,  NULL,         viewnth },
+    { "viewnth",      1000, NULL,         viewnth },
+    { "stackorder",   10,   NULL,         stack },
+    { "stackorder",   100,  NULL,         stack },
+    { "stackorder",   1000, NULL,         stack },
+    { "stackdialogs", 10,   dialogs,      stack },
+    { "stackdialogs", 100,  dialogs,      stack },
+    { "stackdialogs", 1000, dialogs,      stack },
+    { "stackdiff",    10,   NULL,         stackdiffraise },
+    { "stackdiff",    100,  NULL,         stackdiffraise },
+    { "stackdiff",    1000, NULL,         stackdiffraise },
+    { "snap",         1,    NULL,         snap },
+    { "clamp",        0,    NULL,         clamp },
+};
+
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmpll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+    int opt, i, j, repeats = 5;
+    unsigned int k, n = 1000000, iters;
+    const char *only = NULL;
+    long long *ns, start;
+
+    while((opt = getopt(argc, argv, "n:r:c:")) != -1) {
+        switch(opt) {
+        case 'n': n = strtoul(optarg, NULL, 10); break;
+        case 'r': repeats = atoi(optarg); break;
+        case 'c': only = optarg; break;
+        default:
+            fprintf(stderr, "usage: micro [-n iterations] [-r repeats] [-c case]\n");
+            return 1;
+        }
+    }
+    if(n < 1 || repeats < 1 || !(ns = malloc(repeats * sizeof *ns))) {
+        fprintf(stderr, "micro: need an iteration and a repeat\n");
+        return 1;
+    }
+    printf("%-14s %8s %10s\n", "case", "clients", "ns/op");
+    for(i = 0; i < (int)(sizeof cases / sizeof cases[0]); i++) {
+        if(only && strcmp(only, cases[i].name))
+            continue;
+        setup(cases[i].nclients);
+        if(cases[i].prepare)
+            cases[i].prepare();
+        iters = MAX(1, n / MAX(1, cases[i].nclients));
+        for(j = 0; j < repeats; j++) {
+            start = now_ns();
+            for(k = 0; k < iters; k++)
+                cases[i].op(k);
+            ns[j] = now_ns() - start;
+        }
+        qsort(ns, repeats, sizeof *ns, cmpll);
+        printf("%-14s %8d %10.2f\n", cases[i].name, cases[i].nclients, (double)ns[repeats / 2] / iters);
+    }
+    free(ns);
+    return 0;
+}
@@ -0,0 +1,219 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Offline benchmark of the WM's handlers, no X server needed.
+ *
+ * Builds calavera-wm.c against the fake Xlib in fakex.c and drives it like
+ * the main loop does: the fake clients queue their requests, then the WM
+ * handles the batch and finishes it, until the queue stays empty. Replies
+ * and events are synthesized from the fake window tree, so a run costs the
+ * same every time and measures the WM alone. For every case it prints the
+ * median time per operation over the repeats, and the X requests, round
+ * trips and events it took. Runs without $HOME, that is with conf.h and
+ * neither the config file nor the geometry table.
+ *
+ *   manage            a client maps its window
+ *   unmanage          a mapped client exits
+ *   focus             focus() on one of 50 clients
+ *   switcher          the prefix key and Tab among 50 clients
+ *   configurerequest  a burst of 8 ConfigureRequests from a floating client
+ *   relayout          mfact changed with 300 tiled clients
+ *   reload            savestate(), then scan() adopting 500 clients again
+ *
+ * usage: sim [-n iterations] [-r repeats] [-c case]
+ */
+
+#define main calavera_main
+#include "../calavera-wm.c"
+#undef main
+
+#include "fakex.h"
+
+#define MAXWINS 1024
+
+typedef struct {
+    const char *name;
+    int nwins;              /* clients mapped before the timed part */
+    void (*prepare)(void);  /* after they are mapped, not timed */
+    void (*op)(int i);
+} Case;
+
+static Window wins[MAXWINS];
+static int nwins = 0;
+
+/* what the main loop does until nothing is left to do */
+static void settle(void) {
+    do {
+        dispatch();
+        finishbatch();
+    } while(XPending(display));
+}
+
+static void simspawn(int n) {
+    char title[32];
+
+    for(; n > 0 && nwins < MAXWINS; n--) {
+        snprintf(title, sizeof title, "sim %d", nwins);
+        wins[nwins] = fakex_create(display, 40 * (nwins % 16), 30 * (nwins % 16), 640, 480,
+                                   "sim", "Sim", title);
+        fakex_map(display, wins[nwins++]);
+    }
+}
+
+static void killall(void) {
+    while(nwins > 0)
+        fakex_destroy(display, wins[--nwins]);
+    settle();
+}
+
+static void manageop(int i) {
+    simspawn(1);
+    settle();
+}
+
+static void unmanageop(int i) {
+    if(nwins > 0)
+        fakex_destroy(display, wins[--nwins]);
+    settle();
+}
+
+static void focusop(int i) {
+    Client *c;
+
+    if((c = wintoclient(wins[i * 7 % nwins])))
+        focus(c);
+    settle();
+}
+
+static void switcherop(int i) {
+    fakex_key(display, PREFIX_MODKEY, PREFIX_KEYSYM);
+    fakex_key(display, 0, XK_Tab);
+    settle();
+}
+
+static void configureop(int i) {
+    int j;
+
+    for(j = 0; j < 8; j++)
+        fakex_configure(display, wins[0], 100 + j, 100 + (i & 7), 600 + 2 * j, 400 + (i & 7));
+    settle();
+}
+
+static void tileall(void) {
+    Client *c;
+
+    for(c = themon->clients; c; c = c->next)
+        c->isfloating = False;
+    themon->tilefrom = 0;
+    arrange_windows();
+    settle();
+}
+
+static void relayoutop(int i) {
+    Arg arg = { .f = i & 1 ? -0.05 : 0.05 };
+
+    setmfact(&arg);
+    settle();
+}
+
+/* what reload() leaves to the new instance, whose clients start out unknown */
+static void reloadop(int i) {
+    savestate();
+    while(themon->thestack)
+        unmanage(themon->thestack, True); /* no requests, the windows stay */
+    scan();
+    settle();
+}
+
+static const Case cases[] = {
+    { "manage",           0,   NULL,    manageop },
+    { "unmanage",         0,   NULL,    unmanageop },
+    { "focus",            50,  NULL,    focusop },
+    { "switcher",         50,  NULL,    switcherop },
+    { "configurerequest", 1,   NULL,    configureop },
+    { "relayout",         300, tileall, relayoutop },
+    { "reload",           500, NULL,    reloadop },
+};
+
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmpll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* runs a case n times, returns the ns it took and the X traffic in k */
+static long long run(const Case *c, int n, FakeXCounters *k) {
+    int i;
+    long long start;
+    FakeXCounters k0;
+
+    /* unmanage needs the clients it removes, manage starts from none */
+    simspawn(c->op == unmanageop ? n : c->nwins);
+    settle();
+    if(c->prepare)
+        c->prepare();
+    fakex_counters(display, &k0);
+    start = now_ns();
+    for(i = 0; i < n; i++)
+        c->op(i);
+    start = now_ns() - start;
+    fakex_counters(display, k);
+    k->requests -= k0.requests;
+    k->roundtrips -= k0.roundtrips;
+    k->events -= k0.events;
+    k->errors -= k0.errors;
+    killall();
+    return start;
+}
+
+int main(int argc, char *argv[]) {
+    int opt, i, j, n = 100, repeats = 5;
+    const char *only = NULL;
+    long long *ns;
+    FakeXCounters k;
+
+    while((opt = getopt(argc, argv, "n:r:c:")) != -1) {
+        switch(opt) {
+        case 'n': n = atoi(optarg); break;
+        case 'r': repeats = atoi(optarg); break;
+        case 'c': only = optarg; break;
+        default:
+            fprintf(stderr, "usage: sim [-n iterations] [-r repeats] [-c case]\n");
+            return 1;
+        }
+    }
+    if(n < 1 || n > MAXWINS || repeats < 1) {
+        fprintf(stderr, "sim: need 1 to %d iterations and a repeat\n", MAXWINS);
+        return 1;
+    }
+    if(!(ns = malloc(repeats * sizeof *ns)))
+        eprint("fatal: could not malloc() %u bytes\n", repeats * sizeof *ns);
+    /* no config file, geometry table or inotify watch of the user's */
+    unsetenv("HOME");
+    if(!(display = XOpenDisplay(NULL)))
+        eprint("sim: cannot open the fake display\n");
+    cargv = argv;
+    checkotherwm();
+    setup();
+    scan();
+    printf("%-18s %10s %12s %14s %10s\n", "case", "ns/op", "requests/op", "roundtrips/op", "events/op");
+    for(i = 0; i < (int)LENGTH(cases); i++) {
+        if(only && strcmp(only, cases[i].name))
+            continue;
+        for(j = 0; j < repeats; j++)
+            ns[j] = run(&cases[i], n, &k);
+        qsort(ns, repeats, sizeof *ns, cmpll);
+        printf("%-18s %10lld %12.1f %14.1f %10.1f\n", cases[i].name, ns[repeats / 2] / n,
+               (double)k.requests / n, (double)k.roundtrips / n, (double)k.events / n);
+    }
+    cleanup();
+    XCloseDisplay(display);
+    free(ns);
+    return 0;
+}
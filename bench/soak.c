@@ -0,0 +1,262 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Soak test for a running calavera-wm, see soak.sh.
+ *
+ * Every cycle maps a batch of windows and puts them through what a long
+ * session does to the WM: retitles, ConfigureRequest bursts, fullscreen
+ * toggles, keyboard drags (one of them interrupted by the window dying),
+ * withdrawing and destroying, plus a spawn through the prefix key when
+ * built with XTest. The WM's RSS, heap and, with XRes, the number of
+ * server side resources it owns are sampled along the way. After a warm
+ * up the growth over the run is extrapolated from a least squares fit,
+ * and the test fails if it exceeds the tolerances.
+ *
+ * usage: soak -p wmpid [-n cycles] [-s samples] [-r rsskb] [-x resources]
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#ifdef HAVE_XRES
+#include <X11/extensions/XRes.h>
+#endif
+#ifdef HAVE_XTEST
+#include <X11/extensions/XTest.h>
+#endif
+
+#define WINDOWS 8     /* windows per cycle */
+#define WARMUP  5     /* first 1/WARMUP of the samples is not judged */
+
+typedef struct {
+    unsigned long cycle;
+    long rss, heap, res; /* kB, kB, count (-1 if unknown) */
+} Sample;
+
+static Display *dpy;
+static Window root;
+static Atom netwmstate, netfullscreen, netmoveresize;
+static pid_t wmpid;
+
+static void die(const char *msg) {
+    fprintf(stderr, "soak: %s\n", msg);
+    exit(2);
+}
+
+/* value of key in a /proc/pid file, after the line containing section if given */
+static long procvalue(const char *file, const char *section, const char *key) {
+    char path[64], line[256];
+    long v = -1;
+    size_t len = strlen(key);
+    int insection = !section;
+    FILE *f;
+
+    snprintf(path, sizeof path, "/proc/%d/%s", (int)wmpid, file);
+    if(!(f = fopen(path, "r")))
+        die("WM process is gone");
+    while(fgets(line, sizeof line, f)) {
+        if(section && strstr(line, section))
+            insection = 1;
+        else if(insection && !strncmp(line, key, len)) {
+            v = strtol(line + len, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return v;
+}
+
+/* server side resources owned by the WM's connection */
+static long xresources(void) {
+#ifdef HAVE_XRES
+    XResClientIdSpec spec = { None, XRES_CLIENT_ID_PID_MASK };
+    XResClientIdValue *ids;
+    XResType *types;
+    long i, n, count = -1;
+    int ntypes, j;
+
+    if(XResQueryClientIds(dpy, 1, &spec, &n, &ids) != Success)
+        return -1;
+    for(i = 0; i < n; i++) {
+        if(XResGetClientPid(&ids[i]) != wmpid)
+            continue;
+        if(XResQueryClientResources(dpy, ids[i].spec.client, &ntypes, &types) == Success) {
+            for(count = 0, j = 0; j < ntypes; j++)
+                count += types[j].count;
+            XFree(types);
+        }
+        break;
+    }
+    XResClientIdsDestroy(n, ids);
+    return count;
+#else
+    return -1;
+#endif
+}
+
+static void clientmessage(Window w, Atom type, long l0, long l1, long l2) {
+    XEvent ev;
+
+    memset(&ev, 0, sizeof ev);
+    ev.xclient.type = ClientMessage;
+    ev.xclient.window = w;
+    ev.xclient.message_type = type;
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = l0;
+    ev.xclient.data.l[1] = l1;
+    ev.xclient.data.l[2] = l2;
+    XSendEvent(dpy, root, False, SubstructureRedirectMask|SubstructureNotifyMask, &ev);
+}
+
+static void waitmapped(Window w) {
+    XEvent ev;
+
+    do
+        XWindowEvent(dpy, w, StructureNotifyMask, &ev);
+    while(ev.type != MapNotify);
+}
+
+static void spawn(void) {
+#ifdef HAVE_XTEST
+    KeyCode ctrl = XKeysymToKeycode(dpy, XK_Control_L);
+
+    /* C-t c, soak.sh binds c to a command that exits right away */
+    XTestFakeKeyEvent(dpy, ctrl, True, 0);
+    XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_t), True, 0);
+    XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_t), False, 0);
+    XTestFakeKeyEvent(dpy, ctrl, False, 0);
+    XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_c), True, 0);
+    XTestFakeKeyEvent(dpy, XKeysymToKeycode(dpy, XK_c), False, 0);
+#endif
+}
+
+static void cycle(unsigned long n) {
+    char name[64];
+    int i, j;
+    Window w[WINDOWS];
+    XClassHint ch = { "soak", "Soak" };
+
+    for(i = 0; i < WINDOWS; i++) {
+        w[i] = XCreateSimpleWindow(dpy, root, (n * 37 + i * 61) % 800, (n * 17 + i * 43) % 600,
+                                   100 + i * 20, 80 + i * 10, 0, 0, 0);
+        XSelectInput(dpy, w[i], StructureNotifyMask);
+        snprintf(name, sizeof name, "soak %lu/%d", n, i);
+        XStoreName(dpy, w[i], name);
+        XSetClassHint(dpy, w[i], &ch);
+        XMapWindow(dpy, w[i]);
+    }
+    for(i = 0; i < WINDOWS; i++)
+        waitmapped(w[i]);
+    for(i = 0; i < WINDOWS; i++) {
+        snprintf(name, sizeof name, "soak %lu/%d retitled", n, i);
+        XStoreName(dpy, w[i], name);
+        /* _NET_WM_STATE_TOGGLE twice */
+        clientmessage(w[i], netwmstate, 2, netfullscreen, 0);
+        clientmessage(w[i], netwmstate, 2, netfullscreen, 0);
+    }
+    for(j = 0; j < 4; j++)
+        XMoveResizeWindow(dpy, w[2], 10 + j, 10 + j, 200 + j, 150 + j);
+    /* _NET_WM_MOVERESIZE_MOVE_KEYBOARD, then _NET_WM_MOVERESIZE_CANCEL */
+    clientmessage(w[0], netmoveresize, 0, 0, 10);
+    clientmessage(w[0], netmoveresize, 0, 0, 11);
+    /* a client dying in the middle of a drag */
+    if(n % 16 == 0)
+        clientmessage(w[1], netmoveresize, 0, 0, 10);
+    if(n % 64 == 0)
+        spawn();
+    for(i = 0; i < WINDOWS; i++) {
+        if(i % 2)
+            XWithdrawWindow(dpy, w[i], DefaultScreen(dpy));
+        XDestroyWindow(dpy, w[i]);
+    }
+    XSync(dpy, True);
+}
+
+/* growth of the series over the judged samples, from a least squares fit */
+static double growth(Sample *s, int n, size_t off) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, x, y, d;
+    int i, first = n / WARMUP, m = n - first;
+
+    if(m < 2 || *(long *)((char *)&s[first] + off) < 0)
+        return 0;
+    for(i = first; i < n; i++) {
+        x = s[i].cycle;
+        y = *(long *)((char *)&s[i] + off);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    if(!(d = m * sxx - sx * sx))
+        return 0;
+    return (m * sxy - sx * sy) / d * (s[n - 1].cycle - s[first].cycle);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long cycles = 1000000, i;
+    int c, nsamples = 100, n = 0, fail = 0;
+    long rsstol = 1024, restol = 16;
+    double g;
+    Sample *s;
+
+    while((c = getopt(argc, argv, "p:n:s:r:x:")) != -1) {
+        switch(c) {
+        case 'p': wmpid = atoi(optarg); break;
+        case 'n': cycles = strtoul(optarg, NULL, 10); break;
+        case 's': nsamples = atoi(optarg); break;
+        case 'r': rsstol = atol(optarg); break;
+        case 'x': restol = atol(optarg); break;
+        default: die("usage: soak -p wmpid [-n cycles] [-s samples] [-r rsskb] [-x resources]");
+        }
+    }
+    if(!wmpid || nsamples < 2 || cycles < (unsigned long)nsamples)
+        die("usage: soak -p wmpid [-n cycles] [-s samples] [-r rsskb] [-x resources]");
+    if(!(dpy = XOpenDisplay(NULL)))
+        die("cannot open display");
+    if(!(s = calloc(nsamples + 1, sizeof *s)))
+        die("out of memory");
+    root = DefaultRootWindow(dpy);
+    netwmstate = XInternAtom(dpy, "_NET_WM_STATE", False);
+    netfullscreen = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN", False);
+    netmoveresize = XInternAtom(dpy, "_NET_WM_MOVERESIZE", False);
+
+    printf("%12s %10s %10s %10s\n", "cycle", "rss kB", "heap kB", "resources");
+    for(i = 0; i <= cycles; i++) {
+        if(i % (cycles / nsamples) == 0 && n <= nsamples) {
+            s[n].cycle = i;
+            s[n].rss = procvalue("status", NULL, "VmRSS:");
+            s[n].heap = procvalue("smaps", "[heap]", "Rss:");
+            s[n].res = xresources();
+            printf("%12lu %10ld %10ld %10ld\n", i, s[n].rss, s[n].heap, s[n].res);
+            fflush(stdout);
+            n++;
+        }
+        if(i < cycles)
+            cycle(i);
+    }
+
+    if((g = growth(s, n, offsetof(Sample, rss))) > rsstol) {
+        printf("soak: RSS grew by %.0f kB\n", g);
+        fail = 1;
+    }
+    if((g = growth(s, n, offsetof(Sample, heap))) > rsstol) {
+        printf("soak: heap grew by %.0f kB\n", g);
+        fail = 1;
+    }
+    if((g = growth(s, n, offsetof(Sample, res))) > restol) {
+        printf("soak: X resources grew by %.0f\n", g);
+        fail = 1;
+    }
+    if(s[n - 1].res < 0)
+        printf("soak: X resources not tracked, build with XRes\n");
+    printf("soak: %s after %lu cycles\n", fail ? "FAIL" : "ok", cycles);
+    free(s);
+    XCloseDisplay(dpy);
+    return fail;
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Soak test: runs calavera-wm on a private Xvfb and drives it with bench/soak.
+# usage: bench/soak.sh [cycles]   (run from the source directory after make soak)
+
+DPY=:${SOAK_DISPLAY:-99}
+CYCLES=${1:-1000000}
+
+# private HOME so the WM picks up a config binding C-t c to a no-op command
+HOME=$(mktemp -d) || exit 2
+export HOME
+mkdir -p "$HOME/calavera-wm"
+echo 'bind c spawn true' > "$HOME/calavera-wm/config"
+
+Xvfb "$DPY" -screen 0 1280x1024x24 -nolisten tcp >/dev/null 2>&1 &
+XVFB=$!
+sleep 1
+DISPLAY=$DPY ./calavera-wm 2>soak-wm.log &
+WM=$!
+sleep 1
+
+DISPLAY=$DPY bench/soak -p "$WM" -n "$CYCLES"
+STATUS=$?
+
+kill -USR1 "$WM"
+sleep 1
+kill "$WM" "$XVFB"
+rm -rf "$HOME"
+exit $STATUS
@@ -0,0 +1,127 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Prints the state snapshot of a running calavera-wm, see calavera-state.h.
+ *
+ * Lists the windows by number, '*' marks the focused one and the flags are
+ * f(loating), F(ullscreen), h(idden) and s(cratchpad). -s prints the
+ * shown windows in stacking order instead, the topmost first, -c the WM
+ * counters. -w keeps printing
+ * whenever that changes, polling the segment ten times a second.
+ *
+ * usage: calavera-state [-d display] [-s] [-c] [-w]
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "calavera-state.h"
+
+static void die(const char *msg) {
+    fprintf(stderr, "calavera-state: %s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+static void printclients(const CalaveraState *s) {
+    unsigned int i;
+    char flags[5], *f;
+    const CalaveraStateClient *c;
+
+    printf("layout %s area %d,%d %dx%d windows %u\n", s->layout, s->wx, s->wy, s->ww, s->wh, s->total);
+    for(i = 0; i < s->nclients; i++) {
+        c = &s->clients[i];
+        f = flags;
+        if(c->flags & CalaveraStateFloating)
+            *f++ = 'f';
+        if(c->flags & CalaveraStateFullscreen)
+            *f++ = 'F';
+        if(c->flags & CalaveraStateHidden)
+            *f++ = 'h';
+        if(c->flags & CalaveraStateScratch)
+            *f++ = 's';
+        *f = '\0';
+        printf("%3d%c 0x%08lx %5d %5d %5d %5d %-4s %s %s %s\n", s->numbase + (int)i,
+               c->win == s->focus ? '*' : ' ', (unsigned long)c->win, c->x, c->y, c->w, c->h,
+               flags[0] ? flags : "-", c->class, c->instance, c->name);
+    }
+}
+
+static void printstack(const CalaveraState *s) {
+    unsigned int i;
+
+    for(i = 0; i < s->nclients && s->stack[i]; i++)
+        printf("0x%08lx\n", (unsigned long)s->stack[i]);
+}
+
+static void printcounters(const CalaveraState *s) {
+    const CalaveraStateCounters *k = &s->counters;
+
+    printf("pid %u generation %llu\n", s->pid, (unsigned long long)s->generation);
+    printf("events %llu wakeups %llu timers %llu children %llu\n",
+           (unsigned long long)k->events, (unsigned long long)k->wakeups,
+           (unsigned long long)k->timers, (unsigned long long)k->children);
+    printf("focus %llu configreqs %llu configures %llu placements %llu\n",
+           (unsigned long long)k->focus, (unsigned long long)k->configreqs,
+           (unsigned long long)k->configures, (unsigned long long)k->placements);
+    printf("tiles %llu retiles %llu bardraws %llu frames %llu\n",
+           (unsigned long long)k->tiles, (unsigned long long)k->retiles,
+           (unsigned long long)k->bardraws, (unsigned long long)k->frames);
+}
+
+int main(int argc, char *argv[]) {
+    int c, watch = 0;
+    const char *display = NULL;
+    void (*print)(const CalaveraState *) = printclients;
+    const CalaveraState *shm = NULL;
+    CalaveraState *s;
+    uint64_t last = UINT64_MAX;
+    uint32_t seq = 1; /* odd, never seen from a reader */
+
+    while((c = getopt(argc, argv, "d:scw")) != -1) {
+        switch(c) {
+        case 'd': display = optarg; break;
+        case 's': print = printstack; break;
+        case 'c': print = printcounters; break;
+        case 'w': watch = 1; break;
+        default:
+            fprintf(stderr, "usage: calavera-state [-d display] [-s] [-c] [-w]\n");
+            return 1;
+        }
+    }
+    if(!(s = malloc(sizeof *s)))
+        die("malloc");
+    for(;;) {
+        /* a restarted WM reuses the segment, only a new one needs a reopen */
+        if(!shm && !(shm = calavera_state_open(display))
+           && (!watch || (errno != ENOENT && errno != EPROTO)))
+            die("cannot open the state of calavera-wm");
+        if(shm && calavera_state_seq(shm) != seq) {
+            if(calavera_state_read(shm, s) < 0) {
+                if(!watch || (errno != ESTALE && errno != EAGAIN))
+                    die("cannot read the state of calavera-wm");
+                if(errno == ESTALE) {
+                    calavera_state_close(shm);
+                    shm = NULL;
+                    seq = 1;
+                    last = UINT64_MAX;
+                }
+            }
+            /* the counters change with every batch, the rest with generation */
+            else if(print == printcounters || s->generation != last) {
+                print(s);
+                if(watch)
+                    printf("\n");
+                fflush(stdout);
+                seq = s->seq;
+                last = s->generation;
+            }
+            else
+                seq = s->seq;
+        }
+        if(!watch)
+            break;
+        usleep(100000);
+    }
+    calavera_state_close(shm);
+    free(s);
+    return 0;
+}
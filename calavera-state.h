@@ -0,0 +1,89 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * State snapshot calavera-wm publishes in POSIX shared memory, and the
+ * reader library for it (libcalavera-state.a, see libcalavera-state.c).
+ *
+ * The WM updates the segment once per event batch under a seqlock: seq is
+ * odd while it writes, so a reader copies the snapshot between two equal
+ * even reads of seq. Once the segment is mapped, polling it costs neither
+ * system calls nor X round trips. generation only changes with the
+ * clients, the focus or the layout, the counters with every batch.
+ *
+ *     const CalaveraState *shm = calavera_state_open(NULL);
+ *     CalaveraState s;
+ *
+ *     if(shm && !calavera_state_read(shm, &s))
+ *         printf("%u windows\n", s.nclients);
+ */
+
+#ifndef CALAVERA_STATE_H
+#define CALAVERA_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CALAVERA_STATE_MAGIC      0xca1a5e00
+#define CALAVERA_STATE_VERSION    1   /* bumped when the layout changes */
+#define CALAVERA_STATE_MAXCLIENTS 256 /* more are counted but not listed */
+
+/* client flags */
+enum { CalaveraStateFloating = 1, CalaveraStateFullscreen = 2, CalaveraStateHidden = 4,
+       CalaveraStateScratch = 8, CalaveraStateFixed = 16 };
+
+typedef struct {
+    uint64_t win;
+    int32_t x, y, w, h, bw;
+    uint32_t flags;
+    char name[256], class[64], instance[64];
+} CalaveraStateClient;
+
+typedef struct {
+    uint64_t events, wakeups, timers, children;
+    uint64_t focus, configreqs, configures;
+    uint64_t tiles, retiles, bardraws, frames, placements;
+} CalaveraStateCounters;
+
+typedef struct {
+    uint32_t magic, version;
+    uint32_t seq;             /* odd while the WM writes */
+    uint32_t pid;
+    uint64_t generation;      /* bumped when anything but the counters changed */
+    int64_t time;             /* CLOCK_MONOTONIC ms of the last update */
+    int32_t sw, sh;           /* screen size */
+    int32_t wx, wy, ww, wh;   /* window area */
+    char layout[16];
+    int32_t numbase;          /* window number of clients[0] */
+    uint32_t total;           /* managed clients */
+    uint32_t nclients;        /* listed in clients[], in window number order */
+    uint64_t focus;           /* focused window, 0 if none */
+    uint64_t stack[CALAVERA_STATE_MAXCLIENTS]; /* shown windows in stacking order, the topmost first, 0 after the last */
+    CalaveraStateCounters counters;
+    CalaveraStateClient clients[CALAVERA_STATE_MAXCLIENTS];
+} CalaveraState;
+
+/* shm_open() name of the segment for an X display, NULL for $DISPLAY */
+static inline void calavera_state_name(char *buf, size_t size, const char *display, unsigned int uid) {
+    const char *p;
+    size_t n;
+
+    if(!display && !(display = getenv("DISPLAY")))
+        display = ":0";
+    /* the display number only, "host:1.0" and ":1" share one segment */
+    p = (p = strrchr(display, ':')) ? p + 1 : display;
+    n = strcspn(p, ".");
+    snprintf(buf, size, "/calavera-wm-%u-%.*s", uid, (int)n, p);
+}
+
+/* maps the segment read only, NULL with errno set if there is none */
+const CalaveraState *calavera_state_open(const char *display);
+/* copies a consistent snapshot, -1 with errno EAGAIN if the WM is mid update
+ * for too long or ESTALE if it exited */
+int calavera_state_read(const CalaveraState *shm, CalaveraState *s);
+/* changes whenever the WM updated the snapshot, without copying it */
+uint32_t calavera_state_seq(const CalaveraState *shm);
+void calavera_state_close(const CalaveraState *shm);
+
+#endif
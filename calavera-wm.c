@@ -2,13 +2,24 @@
 
 /* headers */
 #include <limits.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
@@ -23,25 +34,61 @@
 /* for multimedia keys, etc. */
 #include <X11/XF86keysym.h>
 
-#define BUFSIZE 256
+/* client and monitor types and the logic on them, see libcalavera.c */
+#include "calavera.h"
+/* layout of the shared state snapshot */
+#include "calavera-state.h"
+
+/* built-in compositor, see the Makefile */
+#ifdef COMPOSITOR
+#include <X11/extensions/shape.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrender.h>
+#endif
+
+#define MAX_TIMERS 16
+#define MAX_LAUNCHES 32 /* commands with launch statistics */
+#define LAUNCH_BUCKETS 10 /* spawn to map histogram, <16ms doubling up to >=4s */
+#define MAX_GLOBSTATES 256 /* per window property */
+#define RELOAD_DELAY 100 /* ms to wait for the config file to settle */
+#define SNAPSHOT_MAGIC 0xca1a0002 /* bump the low bits when the layout changes */
 
 /* macros */
 #define BUTTONMASK              (ButtonPressMask|ButtonReleaseMask)
 #define CLEANMASK(mask)         (mask & ~(numlockmask|LockMask) & (ShiftMask|ControlMask|Mod1Mask|Mod2Mask|Mod3Mask|Mod4Mask|Mod5Mask))
 #define LENGTH(X)               (sizeof X / sizeof X[0])
-#define MAX(A, B)               ((A) > (B) ? (A) : (B))
-#define MIN(A, B)               ((A) < (B) ? (A) : (B))
+#define BITWORD                 (8 * sizeof(unsigned long))
+#define SETBIT(B, I)            ((B)[(I) / BITWORD] |= 1UL << ((I) % BITWORD))
 #define MOUSEMASK               (BUTTONMASK|PointerMotionMask)
-#define WIDTH(X)                ((X)->w + 2 * (X)->bw)
-#define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
 #define RESIZE_MASK             (CWX|CWY|CWWidth|CWHeight|CWBorderWidth)
 #define EVENT_MASK              (EnterWindowMask | FocusChangeMask | PropertyChangeMask | StructureNotifyMask)
 #define WA_EVENT_MASK           SubstructureRedirectMask|SubstructureNotifyMask|ButtonPressMask|PointerMotionMask |EnterWindowMask|LeaveWindowMask|StructureNotifyMask|PropertyChangeMask
 #define ROOT                    RootWindow(display, DefaultScreen(display))
 
+/* round trip tracer, see xtrace.h */
+#ifdef XTRACE
+#include "xtrace.h"
+#else
+#define XTRACE_SCOPE(name)
+#define XTRACE_EVENT(type)
+#define XTRACE_REPORT()
+#endif
+
 /* enums */
 enum { PrefixKey, CmdKey };                              /* prefix key */
 enum { CurNormal, CurResize, CurMove, CurCmd, CurLast }; /* cursor */
+enum { DragNone, DragMove, DragResize };                /* drag */
+enum { SnapWin, SnapX, SnapY, SnapW, SnapH, SnapOldX, SnapOldY, SnapOldW, SnapOldH,
+       SnapBW, SnapOldBW, SnapFlags, SnapListPos, SnapRaisePos, SnapTransFor,
+       SnapLast };                                                /* snapshot record */
+enum { SnapFloating = 1, SnapFullscreen = 2, SnapOldState = 4, SnapNeverFocus = 8,
+       SnapAbove = 16, SnapBelow = 32 };
+enum { WorkHints = 1, WorkName = 2, WorkClass = 4, WorkState = 8 }; /* deferred work */
+enum { SegLayout, SegClients, SegTitle, SegStatus, SegLast };       /* bar segments */
+enum { RuleKeep, RuleYes, RuleNo };                                  /* rule settings */
+enum { RuleClass, RuleInstance, RuleTitle, RuleRole, RuleType, RuleLast }; /* rule patterns */
 
 /* EWMH atoms */
 enum {
@@ -49,6 +96,17 @@ enum {
     NetWMName,
     NetWMState,
     NetWMFullscreen,
+    NetWMAbove,
+    NetWMBelow,
+    NetWMMoveResize,
+    NetWMStrut,
+    NetWMStrutPartial,
+    NetWMWindowType,
+    NetWMWindowTypeDock,
+    NetWorkarea,
+    NetWMPid,
+    NetStartupId,
+    NetClientListStacking,
     NetLast
 };
 
@@ -58,6 +116,8 @@ enum {
     WMDelete,
     WMState,
     WMTakeFocus,
+    WMSnapshot,
+    WMRole,
     WMLast,
 };
 
@@ -72,45 +132,241 @@ typedef struct {
     unsigned int mask;
     unsigned int button;
     void (*func)(const Arg *arg);
-    const Arg arg;
+    Arg arg;
 } Button;
 
-typedef struct Monitor Monitor;
-typedef struct Client Client;
-struct Client {
-    char name[BUFSIZE];
-    float mina, maxa;
-    int x, y, w, h;  /* current position and size */
-    int oldx, oldy, oldw, oldh;
-    int basew, baseh, incw, inch, maxw, maxh, minw, minh;
-    int bw, oldbw;
-    Bool isfixed, isfloating, neverfocus, oldstate, isfullscreen;
-    Client *next;
-    Client *snext;
-    Window win; /* The window */
-};
-
 /* key struct */
 typedef struct {
     unsigned int mod;
     KeySym keysym;
     void (*func)(const Arg *);
-    const Arg arg;
+    Arg arg;
 } Key;
 
-struct Monitor {
-    int num;
-    int mx, my, mw, mh;   /* screen size */
-    int wx, wy, ww, wh;   /* window area  */
-    Client *clients;
-    Client *thesel;
-    Client *thestack;
+/* window rule, see rules[] in conf.h */
+typedef struct {
+    const char *class, *instance, *title, *role, *type; /* globs, NULL matches anything */
+    int floating, fullscreen, focus; /* RuleKeep, RuleYes or RuleNo */
+    int x, y, w, h;                  /* geometry on the monitor, kept if w is 0 */
+} Rule;
+
+/* DFA state, the set of glob positions still alive after some input */
+typedef struct {
+    int *pos, npos;
+    unsigned long *match; /* rules whose glob ended here */
+    int next[256];        /* state after a byte, -1 until needed */
+} GlobState;
+
+typedef struct Exact Exact;
+struct Exact {
+    const char *s;
+    unsigned long *rules;
+    Exact *next;
 };
 
+/* the patterns of all rules for one window property: exact strings are
+ * hashed, globs share one DFA whose states are built while matching */
 typedef struct {
-    const char *class;
-    Bool isfloating;
-} Rule;
+    Bool used;            /* some rule has a pattern here */
+    unsigned long *any;   /* rules without one */
+    Exact *exact[64];
+    char *globs;          /* the globs back to back, each ending in '\0' */
+    int *globrule;        /* rule of each position in globs */
+    int nglobs, maxglobs; /* bytes in globs */
+    int *starts, nstarts;
+    GlobState *states;    /* MAX_GLOBSTATES of room */
+    int nstates, start;   /* start is -1 until built */
+    unsigned int flushes;
+    int *tmp;             /* positions of the state being built */
+    char *mark;
+} RuleField;
+
+/* piece of the bar, redrawn only when its text or place changed */
+typedef struct {
+    char text[BUFSIZE];
+    int x, w;
+} Segment;
+
+#ifdef COMPOSITOR
+/* redirected top level window, the list runs from the top of the stack down */
+typedef struct CompWin CompWin;
+struct CompWin {
+    Window win;
+    int x, y, w, h, bw;
+    Visual *visual;
+    Bool inputonly, mapped, argb, damaged;
+    Bool unredirected;  /* fullscreen and drawn by the server directly */
+    int bypass;         /* _NET_WM_BYPASS_COMPOSITOR, -1 until read */
+    Pixmap pixmap;      /* named window pixmap, valid while mapped */
+    Picture pict;
+    Damage damage;
+    XRenderPictFormat *format;
+    XserverRegion clip; /* ARGB windows, what is left to paint at their level */
+    Pixmap thumbpix;    /* switcher thumbnail, kept while the window lives */
+    Picture thumb;
+    Bool thumbdirty;    /* damaged since the thumbnail was drawn */
+    CompWin *next;
+    CompWin *argbnext;  /* ARGB windows painted over the opaque ones, bottom up */
+};
+
+typedef struct {
+    Bool active;
+    int opcodes[4];     /* Composite, Damage, XFixes and Render major opcodes */
+    int damageev;
+    Window overlay, cmowner;
+    Atom rootpmap;      /* _XROOTPMAP_ID, the wallpaper */
+    Atom bypassatom;    /* _NET_WM_BYPASS_COMPOSITOR */
+    Window bypass;      /* unredirected fullscreen window, None if compositing */
+    long long bypassstart;
+    XRenderPictFormat *format;
+    Picture target, buffer, background;
+    Pixmap bufpix;
+    CompWin *wins;
+    XRectangle *dam;    /* damage since the last frame, screen coordinates */
+    int ndam, maxdam;
+} Compositor;
+#endif
+
+typedef struct {
+    int x, y, w, h;
+} Rect;
+
+/* maximal rectangles of the window area that no floating window covers */
+typedef struct {
+    Rect *r;
+    int n, max;
+    Bool dirty; /* the work area or borders changed, rebuilt by the next placement */
+} FreeSpace;
+
+/* the stacking order commit() applied last and room to compute the next */
+typedef struct {
+    Window *wins;  /* bottom to top, as the server has them */
+    Window *want;  /* the next order, then scratch for applystack() */
+    Client **order; /* the shown clients bottom to top, as last applied */
+    int *work;     /* for stackdiff() */
+    int n, max;    /* windows in wins, room in each */
+    int nclients;  /* clients in order */
+} Stacking;
+
+/* last floating geometry of a window class, see REMEMBER_GEOMETRY */
+struct Geometry {
+    char *key;      /* instance/class or instance/class/role */
+    int x, y, w, h; /* w is 0 until a window of the class floated */
+    Geometry *next;
+};
+
+/* dock or panel reserving space at the screen edges, not managed as a client */
+typedef struct Dock Dock;
+struct Dock {
+    Window win;
+    long strut[4]; /* left, right, top, bottom */
+    Dock *next;
+};
+
+typedef struct {
+    const char *instance; /* WM_CLASS instance the window is adopted by */
+    const char **cmd;
+} Scratchpad;
+
+/* scratchpad slot, its client is out of the client lists while hidden */
+typedef struct {
+    Client *c;
+    Bool spawned; /* command started, window not adopted yet */
+    Bool show;    /* toggled before the window appeared */
+} Scratch;
+
+/* settings conf.h compiles in and the config file can replace at runtime */
+typedef struct {
+    unsigned long focuscolor, unfocuscolor;
+    int bordersize, snap, topsize, bottomsize;
+    unsigned int prefixmod;
+    KeySym prefixkey;
+    Key *keys;
+    unsigned int nkeys;
+    Button *buttons;
+    unsigned int nbuttons;
+    const Rule *rules;
+    unsigned int nrules;
+    void **mem; /* allocations owned by this config */
+    unsigned int nmem;
+} Config;
+
+/* interactive move/resize in progress, fed by the main loop */
+typedef struct {
+    int type;           /* DragNone, DragMove or DragResize */
+    Bool keyboard;      /* driven by keypress() instead of the pointer */
+    Client *c;
+    int px, py;         /* pointer at start */
+    int ox, oy, ow, oh; /* client geometry at start */
+} Drag;
+
+/* launch statistics of a command, keyed by argv[0] without the path */
+typedef struct {
+    char cmd[64];
+    unsigned long spawns, maps, timeouts, dups, failures;
+    unsigned long hist[LAUNCH_BUCKETS]; /* spawn to first map */
+    long long total, max;               /* ms to the first map, summed */
+} Launch;
+
+/* a child spawned by the WM, until it is reaped */
+typedef struct Child Child;
+struct Child {
+    pid_t pid;
+    long long start;  /* now_ms() at the fork */
+    Bool pending;     /* no window managed yet and SPAWN_TIMEOUT not over */
+    char id[64];      /* DESKTOP_STARTUP_ID it was given */
+    char app[64];     /* class runorraise() waits for, "" if none */
+    Launch *launch;   /* NULL if the table is full */
+    Child *next;
+};
+
+/* one-shot timer, deadline on CLOCK_MONOTONIC in ms, unused if func is NULL */
+typedef struct {
+    long long when;
+    void (*func)(void *arg);
+    void *arg;
+} Timer;
+
+/* counters dumped on SIGUSR1 */
+typedef struct {
+    unsigned long events;   /* X events dispatched */
+    unsigned long wakeups;  /* epoll_wait() returns */
+    unsigned long timers;   /* timers fired */
+    unsigned long children; /* children reaped */
+    unsigned long workidle; /* deferred tasks run while idle */
+    unsigned long workforced; /* deferred tasks run on demand */
+    unsigned long focus;    /* focus changes */
+    unsigned long focusapplied; /* of them sent to the server */
+    unsigned long restacks; /* stacking order changes at the end of a batch */
+    unsigned long restacked; /* windows they moved */
+    unsigned long hovers;   /* EnterNotify on clients with focus follows mouse */
+    unsigned long inputs;   /* key and button presses */
+    unsigned long configreqs; /* ConfigureRequests received */
+    unsigned long configures; /* configures and synthetic replies they caused */
+    unsigned long tiles;    /* tiles recomputed */
+    unsigned long retiles;  /* tiled windows reconfigured */
+    long long inputlag;     /* us spent on earlier events of the batch, summed */
+    long long maxinputlag;
+    unsigned long bardraws; /* bar updates */
+    unsigned long barsegs;  /* bar segments redrawn */
+    long long bartime;      /* us spent drawing the bar, summed */
+    long long maxbartime;
+    unsigned long frames;   /* compositor repaints */
+    unsigned long culled;   /* windows skipped as occluded or undamaged */
+    long long framearea;    /* pixels repainted, summed */
+    long long frametime;    /* us spent building frames, summed */
+    long long maxframetime;
+    unsigned long switchers; /* switcher overlay draws */
+    unsigned long thumbs;   /* thumbnails rendered again */
+    unsigned long rulematches; /* windows matched against the rules */
+    long long ruletime;     /* us spent matching, summed */
+    unsigned long globstates; /* DFA states built */
+    unsigned long placements; /* new windows placed */
+    long long placetime;    /* us spent placing them, summed */
+    long long maxplacetime;
+    unsigned long bypasses; /* fullscreen windows unredirected */
+    long long bypasstime;   /* ms spent unredirected, summed */
+} Stats;
 
 /* DATA */
 
@@ -118,47 +374,172 @@ typedef struct {
 static void ewmh_init(void);
 static long ewmh_getstate(Window w);
 static void ewmh_setclientstate(Client *c, long state);
+static void ewmh_setwmstate(Client *c);
+static Bool ewmh_statechange(long action, Bool set);
 static Bool sendevent(Client *c, Atom proto);
 
 // bar
-static void set_padding(void);
+static void drawbar(void);
+static void drawsegment(Segment *seg, unsigned long bg);
+static void freebar(void);
+static void initbar(void);
+static void initfont(void);
+static void drawswitcher(void);
+static void freeswitcher(void);
+static void switcherexpire(void *arg);
+static Bool set_padding(void);
+static void updatebarpos(void);
+
+#ifdef COMPOSITOR
+// compositor
+static CompWin *compadd(Window w);
+static void compbackground(void);
+static void compbypass(void);
+static void compcleanup(void);
+static void compconfigure(XConfigureEvent *ev);
+static void compdamage(int x, int y, int w, int h);
+static void compevent(XEvent *e);
+static Bool comperror(XErrorEvent *ee);
+static CompWin *compfind(Window w);
+static void compinit(void);
+static void compmap(CompWin *cw);
+static void comppaint(void);
+static void compredirect(void);
+static void compremove(CompWin *cw);
+static void compresize(void);
+static void comprestack(CompWin *cw, Window above);
+static void compthumb(CompWin *cw);
+static void compunmap(CompWin *cw);
+static void compunredirect(CompWin *cw);
+#endif
+
+// geometry memory
+static Bool geomapply(Client *c);
+static Geometry *geomfind(const char *key, Bool create);
+static void geomload(void);
+static void geomremember(Client *c);
+static void geomsave(void *arg);
+
+// docks
+static Bool getstrut(Window w, Atom prop, long *strut);
+static Bool inlostarea(Client *c, int ox, int oy, int ow, int oh);
+static Bool isdock(Window w);
+static void managedock(Window w);
+static void unmanagedock(Dock *d);
+static Bool updatestrut(Dock *d);
+static void updateworkarea(void);
+static Dock *wintodock(Window w);
 
 // clients
-static Bool applysizehints(Client *c, int *x, int *y, int *w, int *h, Bool interact);
-static void attach(Client *c);
-static void attachstack(Client *c);
-static void attachend(Client *c);
-static void attachstackend(Client *c);
 static void border_init(Client *c);
 static void configure(Client *c);
-static void detach(Client *c);
-static void detachstack(Client *c);
 static void focus(Client *c);
 static void killclient(Client *c);
 static void grabbuttons(Client *c, Bool focused);
 static void resize(Client *c, int x, int y, int w, int h, Bool interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
 static void setfocus(Client *c);
+static void setfloating(Client *c, Bool floating);
 static void setfullscreen(Client *c, Bool fullscreen);
 static void showhide(Client *c);
 static void unfocus(Client *c, Bool setfocus);
 static void unmanage(Client *c, Bool destroyed);
+static void updateclass(Client *c);
 static void updatesizehints(Client *c);
+static void updatetitle(Client *c);
 static Client *wintoclient(Window w);
 
+// drag
+static void dragkey(KeySym keysym);
+static void dragmotion(int x, int y);
+static void dragstart(Client *c, int type, Bool keyboard);
+static void dragstop(Bool restore);
+
 // events
 static void buttonpress(XEvent *e);
+static void buttonrelease(XEvent *e);
 static void clientmessage(XEvent *e);
 static void configurenotify(XEvent *e);
 static void configurerequest(XEvent *e);
+static Bool isconfigurerequest(Display *dpy, XEvent *e, XPointer arg);
 static void destroynotify(XEvent *e);
+static void enternotify(XEvent *e);
+static void expose(XEvent *e);
 static void focusin(XEvent *e);
 static void keypress(XEvent *e);
 static void mappingnotify(XEvent *e);
 static void maprequest(XEvent *e);
+static void motionnotify(XEvent *e);
 static void propertynotify(XEvent *e);
 static void unmapnotify(XEvent *e);
 
+// config
+static void *cfgalloc(Config *cfg, size_t size);
+static void applyconfig(Config *new);
+static void defaultconfig(Config *cfg);
+static void freeconfig(Config *cfg);
+static void loadconfig(void *arg);
+static Bool parsebinding(Config *cfg, char **tok, int ntok, Arg *arg,
+                         void (**func)(const Arg *));
+static Bool parseconfig(const char *path, Config *cfg);
+static Bool parsemods(const char *spec, unsigned int *mod, const char **rest);
+static Bool parserule(Config *cfg, char **tok, int ntok, Rule *r);
+static int splitline(char *line, char **tok, int max);
+static void watchconfig(void);
+
+// deferred work
+static void dequeuework(Client *c);
+static void dowork(Client *c, unsigned int work);
+static void dropwork(Client *c, unsigned int work);
+static void flushwork(Client *c, unsigned int work);
+static void queuework(Client *c, unsigned int work);
+static void runwork(void);
+
+// layouts
+static void arrangetiles(Monitor *m);
+static void grid(Monitor *m, int n, int i, int *x, int *y, int *w, int *h);
+static void monocle(Monitor *m, int n, int i, int *x, int *y, int *w, int *h);
+static void tile(Monitor *m, int n, int i, int *x, int *y, int *w, int *h);
+static void tiledirty(Client *c);
+
+// placement
+static long overlap(int x, int y, int w, int h, long limit);
+static void placeadd(int x, int y, int w, int h);
+static void placeclient(Client *c);
+static void placecut(int from, int x, int y, int w, int h, const Rect *keep);
+static void placefree(Client *skip, const Rect *r);
+static void placemove(Client *c, const Rect *old);
+static void placepush(int x, int y, int w, int h);
+static void placerebuild(void);
+static void placetry(int x, int y, int w, int h, int *bx, int *by, long *best);
+
+// rules
+static int globstate(RuleField *f, int *pos, int npos);
+static unsigned long *globmatch(RuleField *f, const char *s);
+static void rulecompile(void);
+static void rulefree(void);
+static Rule rulematch(Client *c, Window trans);
+static const char *windowtype(Client *c, Window trans);
+
+// children
+static void childexit(Child *c, int status);
+static Child *childfind(Window w);
+static Launch *childlaunch(const char *cmd);
+static void childmapped(Child *c);
+static Child *childpending(const char *app);
+static void spawnchild(char **argv, const char *app);
+
+// scratchpads
+static Bool scratchadopt(Client *c, XWindowAttributes *wa);
+static void scratchhide(Client *c);
+static void scratchshow(Client *c);
+static void scratchstart(void);
+
+// shared state
+static void stateclose(void);
+static void stateinit(void);
+static void statepublish(void);
+
 // manage
 static void grabkeys(int keytype);
 static void manage(Window w, XWindowAttributes *wa);
@@ -171,18 +552,42 @@ static void checkotherwm(void);
 static void cleanup(void);
 static void eprint(const char *errstr, ...);
 static Bool getrootptr(int *x, int *y);
+static Bool gettextprop(Window w, Atom atom, char *text, unsigned int size);
 static void init_cursors(void);
-static void handle_events(void);
+static int intcmp(const void *a, const void *b);
+static unsigned int restorestate(Window *wins, unsigned int num);
+static void savestate(void);
 static void scan(void);
+static int wincmp(const void *a, const void *b);
 static void setup(void);
-static void sigchld(int unused);
 static void sync_display(void);
 static int xerror(Display *display, XErrorEvent *ee);
 static int xerrordummy(Display *display, XErrorEvent *ee);
 static int xerrorstart(Display *display, XErrorEvent *ee);
 
+// loop
+static void canceltimer(int id);
+static void dispatch(void);
+static void finishbatch(void);
+static void handle_events(void);
+static void handle_inotify(void);
+static void handle_signals(void);
+static void handle_timers(void);
+static void hoverexpire(void *arg);
+static void loop_init(void);
+static long long now_ms(void);
+static long long now_us(void);
+static void prefixexpire(void *arg);
+static void printstats(void);
+static void reap(void);
+static int settimer(int ms, void (*func)(void *), void *arg);
+static void statstimer(void *arg);
+static void updatetimer(void);
+
 // monitor
+static Bool applystack(void);
 static void arrange_windows(void);
+static void commit(void);
 static Monitor *createmon(void);
 static void restack(void);
 static Bool updategeom(void);
@@ -194,13 +599,19 @@ static void switcher(const Arg *arg);
 static void killfocused(const Arg *arg);
 static void exec(const Arg *arg);
 static void maximize(const Arg *arg);
+static void movekeyboard(const Arg *arg);
 static void movemouse(const Arg *arg);
+static void nextlayout(const Arg *arg);
 static void quit(const Arg *arg);
 static void reload(const Arg *arg);
+static void resizekeyboard(const Arg *arg);
 static void resizemouse(const Arg *arg);
 static void runorraise(const Arg *arg);
+static void setmfact(const Arg *arg);
 static void spawn(const Arg *arg);
 static void fullscreen(const Arg *arg);
+static void togglefloating(const Arg *arg);
+static void togglescratch(const Arg *arg);
 static void view(const Arg *arg);
 
 /* variables */
@@ -208,17 +619,67 @@ static char **cargv;
 static int screen, screen_w, screen_h;  /* X display screen geometry width, height */
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0; /* dynamic key lock mask */
+static int prefixset = 0, prefixtimer = 0; /* waiting for a command key */
+static int epfd = -1, sigfd = -1, tmrfd = -1, inofd = -1; /* main loop descriptors */
+static sigset_t sigmask, origmask; /* signals routed through sigfd */
+static Timer timers[MAX_TIMERS];
+static Child *children = NULL; /* spawned and not reaped yet */
+static Launch launches[MAX_LAUNCHES];
+static Client *workhead = NULL, *worktail = NULL; /* deferred work queue */
+static Bool layoutdirty = False, focusdirty = False, stackdirty = False; /* for commit() */
+static Client *xfocus = NULL; /* the client the server last got the focus for */
+static Dock *docks = NULL;
+static FreeSpace freespace = { NULL, 0, 0, True };
+static Stacking stacking = { NULL, NULL, NULL, NULL, 0, 0, 0 };
+static RuleField rulefields[RuleLast]; /* cfg.rules compiled */
+static const size_t rulepatterns[RuleLast] = { /* the patterns in Rule */
+    offsetof(Rule, class), offsetof(Rule, instance), offsetof(Rule, title),
+    offsetof(Rule, role), offsetof(Rule, type),
+};
+static int rulewords = 1; /* unsigned longs in a rule bitset */
+static Geometry *geometry[256]; /* hash table of remembered geometries */
+static char geompath[PATH_MAX];
+static int geomtimer = 0; /* batches writes of the table */
+static CalaveraState *shstate = NULL; /* shared memory snapshot, see calavera-state.h */
+static Window barwin = None; /* built-in bar, see SHOW_BAR */
+static Pixmap barpix;
+static GC bargc;
+static XFontStruct *font;   /* bar and switcher overlay */
+static int barh = 0;
+static Segment segs[SegLast];
+static Bool bardirty = False;
+static char stext[BUFSIZE]; /* status text, the root window name */
+static Window switchwin = None; /* switcher overlay, see SWITCHER_OVERLAY */
+static Pixmap switchpix;
+static GC switchgc;
+static int switchw, switchh, switchtimer = 0;
+#ifdef COMPOSITOR
+static Compositor comp;
+static Picture switchpict;
+#endif
+static int hovertimer = 0; /* focus follows mouse */
+static int hoverx, hovery, focusx, focusy; /* pointer at last EnterNotify and last hover focus */
+static Window hoverwin = None;
+static Drag drag;
+static Config cfg;
+static char cfgpath[PATH_MAX];
+static int cfgtimer = 0; /* coalesces bursts of inotify events */
+static Stats stats;
 /* Events array */
 static void (*handler[LASTEvent]) (XEvent *) = {
     [ButtonPress] = buttonpress,
+    [ButtonRelease] = buttonrelease,
     [ClientMessage] = clientmessage,
     [ConfigureRequest] = configurerequest,
     [ConfigureNotify] = configurenotify,
     [DestroyNotify] = destroynotify,
+    [EnterNotify] = enternotify,
+    [Expose] = expose,
     [FocusIn] = focusin,
     [KeyPress] = keypress,
     [MappingNotify] = mappingnotify,
     [MapRequest] = maprequest,
+    [MotionNotify] = motionnotify,
     [PropertyNotify] = propertynotify,
     [UnmapNotify] = unmapnotify
 };
@@ -232,107 +693,184 @@ static Window root;
 /* configuration, allows nested code to access above variables */
 #include "conf.h"
 
+static Scratch scratch[LENGTH(scratchpads)];
+
+/* actions the config file can bind, with the argument they take */
+enum { ArgNone, ArgInt, ArgFloat, ArgCmd, ArgRaise };
+static const struct {
+    const char *name;
+    void (*func)(const Arg *);
+    int argtype;
+} actions[] = {
+    { "banish",         banish,         ArgNone },
+    { "center",         center,         ArgNone },
+    { "exec",           exec,           ArgNone },
+    { "fullscreen",     fullscreen,     ArgNone },
+    { "killfocused",    killfocused,    ArgNone },
+    { "maximize",       maximize,       ArgNone },
+    { "movekeyboard",   movekeyboard,   ArgNone },
+    { "movemouse",      movemouse,      ArgNone },
+    { "nextlayout",     nextlayout,     ArgInt },
+    { "quit",           quit,           ArgNone },
+    { "reload",         reload,         ArgNone },
+    { "resizekeyboard", resizekeyboard, ArgNone },
+    { "resizemouse",    resizemouse,    ArgNone },
+    { "runorraise",     runorraise,     ArgRaise },
+    { "setmfact",       setmfact,       ArgFloat },
+    { "spawn",          spawn,          ArgCmd },
+    { "switcher",       switcher,       ArgInt },
+    { "togglefloating", togglefloating, ArgNone },
+    { "togglescratch",  togglescratch,  ArgInt },
+    { "view",           view,           ArgInt },
+};
+
 /* function implementations */
-Bool applysizehints(Client *c, int *x, int *y, int *w, int *h, Bool interact) {
-    Bool baseismin;
-
-    /* set minimum possible */
-    *w = MAX(1, *w);
-    *h = MAX(1, *h);
-    if(interact) {
-        if(*x > screen_w)
-            *x = screen_w - WIDTH(c);
-        if(*y > screen_h)
-            *y = screen_h - HEIGHT(c);
-        if(*x + *w + 2 * c->bw < 0)
-            *x = 0;
-        if(*y + *h + 2 * c->bw < 0)
-            *y = 0;
-    }
-    else {
-        if(*x >= themon->wx + themon->ww)
-            *x = themon->wx + themon->ww - WIDTH(c);
-        if(*y >= themon->wy + themon->wh)
-            *y = themon->wy + themon->wh - HEIGHT(c);
-        if(*x + *w + 2 * c->bw <= themon->wx)
-            *x = themon->wx;
-        if(*y + *h + 2 * c->bw <= themon->wy)
-            *y = themon->wy;
-    }
-    if(*h < TOP_SIZE)
-        *h = TOP_SIZE;
-    if(*w < TOP_SIZE)
-        *w = TOP_SIZE;
-    if(c->isfloating) {
-        /* see last two sentences in ICCCM 4.1.2.3 */
-        baseismin = c->basew == c->minw && c->baseh == c->minh;
-        if(!baseismin) { /* temporarily remove base dimensions */
-            *w -= c->basew;
-            *h -= c->baseh;
-        }
-        /* adjust for aspect limits */
-        if(c->mina > 0 && c->maxa > 0) {
-            if(c->maxa < (float)*w / *h)
-                *w = *h * c->maxa + 0.5;
-            else if(c->mina < (float)*h / *w)
-                *h = *w * c->mina + 0.5;
-        }
-        if(baseismin) { /* increment calculation requires this */
-            *w -= c->basew;
-            *h -= c->baseh;
+/* switch to a freshly parsed config, touching only what changed */
+void applyconfig(Config *new) {
+    unsigned int i;
+    Bool regrabkeys, regrabbuttons, recolor, reborder, repad;
+    Client *c;
+    Config old = cfg;
+
+    regrabkeys = new->prefixkey != old.prefixkey || new->prefixmod != old.prefixmod;
+    regrabbuttons = new->nbuttons != old.nbuttons;
+    for(i = 0; !regrabbuttons && i < new->nbuttons; i++)
+        regrabbuttons = new->buttons[i].button != old.buttons[i].button
+                        || new->buttons[i].mask != old.buttons[i].mask;
+    recolor = new->focuscolor != old.focuscolor || new->unfocuscolor != old.unfocuscolor;
+    reborder = new->bordersize != old.bordersize;
+    repad = new->topsize != old.topsize || new->bottomsize != old.bottomsize;
+    cfg = *new;
+    freeconfig(&old);
+    rulecompile();
+
+    /* in command mode the prefix key is regrabbed once the command is done */
+    if(regrabkeys && !prefixset)
+        grabkeys(PrefixKey);
+    for(c = themon->clients; c; c = c->next) {
+        if(regrabbuttons)
+            grabbuttons(c, c == themon->thesel);
+        if(reborder) {
+            if(c->isfullscreen)
+                c->oldbw = cfg.bordersize;
+            else {
+                c->bw = cfg.bordersize;
+                resizeclient(c, c->x, c->y, c->w, c->h);
+            }
         }
-        /* adjust for increment value */
-        if(c->incw)
-            *w -= *w % c->incw;
-        if(c->inch)
-            *h -= *h % c->inch;
-        /* restore base dimensions */
-        *w = MAX(*w + c->basew, c->minw);
-        *h = MAX(*h + c->baseh, c->minh);
-        if(c->maxw)
-            *w = MIN(*w, c->maxw);
-        if(c->maxh)
-            *h = MIN(*h, c->maxh);
-    }
-    return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
-}
-
-void arrange_windows() {
-    if(themon)
-        showhide(themon->thestack);
-    restack();
+        if(recolor)
+            XSetWindowBorder(display, c->win,
+                             c == themon->thesel ? cfg.focuscolor : cfg.unfocuscolor);
+    }
+    if(recolor && barwin) {
+        segs[SegTitle].w = -1;
+        bardirty = True;
+    }
+    if(reborder) {
+        themon->tilefrom = 0;
+        freespace.dirty = True; /* every floating window grew or shrank */
+    }
+    if(repad)
+        updateworkarea();
+    else if(reborder)
+        arrangetiles(themon);
 }
 
-void attachend(Client *c) {
-    Client *p = themon->clients;
-
-    if(p) {
-        for(; p->next; p = p->next);
-        p->next = c;
-    }  else {
-        attach(c);
+/* bring the server to stackorder() with the bar and the docks between the
+ * normal and the above layer: one raise if the top changed and a single
+ * XRestackWindows() of the part in which windows moved, then the new order
+ * in _NET_CLIENT_LIST_STACKING; True if the order changed */
+Bool applystack(void) {
+    Client *c;
+    Dock *d;
+    Window *w;
+    int i, j, n = 1, nc, nbelow, lo, hi;
+    Bool moved;
+
+    for(c = themon->raised; c; c = c->rnext)
+        n++;
+    for(d = docks; d; d = d->next)
+        n++;
+    if(n > stacking.max) {
+        stacking.max = MAX(2 * stacking.max, n);
+        if(!(stacking.wins = realloc(stacking.wins, stacking.max * sizeof *stacking.wins))
+           || !(stacking.want = realloc(stacking.want, stacking.max * sizeof *stacking.want))
+           || !(stacking.order = realloc(stacking.order, stacking.max * sizeof *stacking.order))
+           || !(stacking.work = realloc(stacking.work, 4 * stacking.max * sizeof *stacking.work)))
+            eprint("fatal: could not realloc() %u bytes\n", 4 * stacking.max * sizeof *stacking.work);
+    }
+    nc = stacking.nclients = stackorder(themon, stacking.order, &nbelow);
+    for(i = n = 0; i <= nc; i++) {
+        if(i == nbelow) {
+            if(barwin)
+                stacking.want[n++] = barwin;
+            for(d = docks; d; d = d->next)
+                stacking.want[n++] = d->win;
+        }
+        if(i < nc)
+            stacking.want[n++] = stacking.order[i]->win;
+    }
+    moved = stackdiff(stacking.wins, stacking.n, stacking.want, n, &lo, &hi, stacking.work);
+    if(!moved && n == stacking.n)
+        return False;
+    /* the new order is what the server has from here on, the old buffer is scratch */
+    w = stacking.wins;
+    stacking.wins = stacking.want;
+    stacking.want = w;
+    stacking.n = n;
+    if(moved) {
+        stats.restacked += hi - lo;
+        if(hi == n)
+            XRaiseWindow(display, stacking.wins[--hi]);
+        /* top to bottom, each below the one before, from the window above
+         * the part that stays where it is */
+        for(i = hi, j = 0; i >= lo; i--)
+            w[j++] = stacking.wins[i];
+        if(j > 1)
+            XRestackWindows(display, w, j);
     }
+    /* every managed window, the hidden scratchpads below the rest */
+    for(j = 0, c = themon->raised; c; c = c->rnext)
+        if(c->ishidden)
+            w[j++] = c->win;
+    for(i = 0; i < nc; i++)
+        w[j++] = stacking.order[i]->win;
+    XChangeProperty(display, root, netatom[NetClientListStacking], XA_WINDOW, 32,
+                    PropModeReplace, (unsigned char *)w, j);
+    return moved;
 }
 
-void attach(Client *c) {
-    c->next = themon->clients;
-    themon->clients = c;
+/* lay the windows out again once the batch is done, see commit() */
+void arrange_windows() {
+    bardirty = True;
+    layoutdirty = True;
+    stackdirty = True;
 }
 
-void attachstackend(Client *c) {
-    Client *p = themon->thestack;
+/* reconfigure the tiles from m->tilefrom on whose rectangle changed */
+void arrangetiles(Monitor *m) {
+    int i, n, x, y, w, h;
+    Client *c;
 
-    if(p) {
-        for(; p->snext; p = p->snext);
-        p->snext = c;
-    } else {
-        attachstack(c);
+    for(n = 0, c = m->clients; c; c = c->next)
+        if(ISTILED(c))
+            n++;
+    if(n != m->ntiles && !m->lt->local)
+        m->tilefrom = 0;
+    m->ntiles = n;
+    for(i = 0, c = m->clients; c && m->tilefrom < n; c = c->next) {
+        if(!ISTILED(c) || i++ < m->tilefrom)
+            continue;
+        m->lt->tile(m, n, i - 1, &x, &y, &w, &h);
+        stats.tiles++;
+        w -= 2 * c->bw;
+        h -= 2 * c->bw;
+        if(x != c->x || y != c->y || w != c->w || h != c->h) {
+            resizeclient(c, x, y, w, h);
+            stats.retiles++;
+        }
     }
-}
-
-void attachstack(Client *c) {
-    c->snext = themon->thestack;
-    themon->thestack = c;
+    m->tilefrom = INT_MAX;
 }
 
 void autorun(){
@@ -366,10 +904,15 @@ void buttonpress(XEvent *e) {
         focus(c);
         click = 1;
     }
-    for(i = 0; i < LENGTH(buttons); i++)
-        if(click && buttons[i].func && buttons[i].button == ev->button
-           && CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state))
-            buttons[i].func(&buttons[i].arg);
+    for(i = 0; i < cfg.nbuttons; i++)
+        if(click && cfg.buttons[i].func && cfg.buttons[i].button == ev->button
+           && CLEANMASK(cfg.buttons[i].mask) == CLEANMASK(ev->state))
+            cfg.buttons[i].func(&cfg.buttons[i].arg);
+}
+
+void buttonrelease(XEvent *e) {
+    if(drag.type != DragNone && !drag.keyboard)
+        dragstop(False);
 }
 
 void banish(const Arg *arg) {
@@ -381,7 +924,24 @@ void border_init(Client *c) {
 
     wc.border_width = c->bw;
     XConfigureWindow(display, c->win, CWBorderWidth, &wc);
-    XSetWindowBorder(display, c->win, FOCUS);
+    XSetWindowBorder(display, c->win, cfg.focuscolor);
+}
+
+void canceltimer(int id) {
+    if(id <= 0 || id > MAX_TIMERS)
+        return;
+    timers[id - 1].func = NULL;
+    updatetimer();
+}
+
+void *cfgalloc(Config *cfg, size_t size) {
+    void *p, **mem;
+
+    if(!(p = calloc(1, size)) || !(mem = realloc(cfg->mem, (cfg->nmem + 1) * sizeof *mem)))
+        eprint("fatal: could not malloc() %u bytes\n", size);
+    mem[cfg->nmem++] = p;
+    cfg->mem = mem;
+    return p;
 }
 
 void center(const Arg *arg) {
@@ -392,6 +952,185 @@ void center(const Arg *arg) {
     arrange_windows();
 }
 
+/* take the remembered geometry of c's class if it floats, the entry is
+ * created here so that c's geometry can be remembered later */
+Bool geomapply(Client *c) {
+    char key[3 * BUFSIZE + 2], role[BUFSIZE] = "";
+    Geometry *g;
+
+    if(!c->instance[0] && !c->class[0])
+        return False;
+    if(GEOMETRY_BY_ROLE)
+        gettextprop(c->win, wmatom[WMRole], role, sizeof role);
+    snprintf(key, sizeof key, role[0] ? "%s/%s/%s" : "%s/%s", c->instance, c->class, role);
+    g = c->geom = geomfind(key, True);
+    if(!g->w || !c->isfloating)
+        return False;
+    c->w = g->w;
+    c->h = g->h;
+    c->x = g->x;
+    c->y = g->y;
+    clamptoarea(themon, WIDTH(c), HEIGHT(c), &c->x, &c->y);
+    return True;
+}
+
+/* the entry of key, a new empty one if create is set */
+Geometry *geomfind(const char *key, Bool create) {
+    unsigned int h = 2166136261u; /* FNV-1a */
+    const char *p;
+    Geometry *g;
+
+    for(p = key; *p; p++)
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    h %= LENGTH(geometry);
+    for(g = geometry[h]; g && strcmp(g->key, key); g = g->next);
+    if(g || !create)
+        return g;
+    if(!(g = calloc(1, sizeof(Geometry))) || !(g->key = strdup(key)))
+        eprint("fatal: could not malloc() %u bytes\n", sizeof(Geometry) + strlen(key) + 1);
+    g->next = geometry[h];
+    geometry[h] = g;
+    return g;
+}
+
+/* ~/calavera-wm/geometry, lines of "x y w h key" */
+void geomload(void) {
+    char line[4 * BUFSIZE];
+    char *home;
+    int n, x, y, w, h;
+    FILE *f;
+    Geometry *g;
+
+    if(!(home = getenv("HOME")))
+        return;
+    snprintf(geompath, sizeof(geompath), "%s/calavera-wm/geometry", home);
+    if(!(f = fopen(geompath, "r")))
+        return;
+    while(fgets(line, sizeof line, f)) {
+        line[strcspn(line, "\n")] = '\0';
+        if(sscanf(line, "%d %d %d %d %n", &x, &y, &w, &h, &n) != 4 || w <= 0 || h <= 0 || !line[n])
+            continue;
+        g = geomfind(line + n, True);
+        g->x = x;
+        g->y = y;
+        g->w = w;
+        g->h = h;
+    }
+    fclose(f);
+}
+
+/* keep c's floating geometry for the next window of its class, saved lazily */
+void geomremember(Client *c) {
+    Geometry *g = c->geom;
+
+    if(!g || !c->isfloating || c->isfullscreen || c->scratch
+       || (g->x == c->x && g->y == c->y && g->w == c->w && g->h == c->h))
+        return;
+    g->x = c->x;
+    g->y = c->y;
+    g->w = c->w;
+    g->h = c->h;
+    if(!geomtimer)
+        geomtimer = settimer(GEOMETRY_SAVE_DELAY, geomsave, NULL);
+}
+
+/* the whole table at once, through a temporary file so a crash can't truncate it */
+void geomsave(void *arg) {
+    char tmp[PATH_MAX + 8];
+    unsigned int i;
+    FILE *f;
+    Geometry *g;
+
+    geomtimer = 0;
+    if(!geompath[0])
+        return;
+    snprintf(tmp, sizeof tmp, "%s.new", geompath);
+    if(!(f = fopen(tmp, "w"))) {
+        fprintf(stderr, "calavera-wm: cannot write %s: %s\n", tmp, strerror(errno));
+        return;
+    }
+    for(i = 0; i < LENGTH(geometry); i++)
+        for(g = geometry[i]; g; g = g->next)
+            if(g->w)
+                fprintf(f, "%d %d %d %d %s\n", g->x, g->y, g->w, g->h, g->key);
+    if(fclose(f) || rename(tmp, geompath) < 0) {
+        fprintf(stderr, "calavera-wm: cannot write %s: %s\n", geompath, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+/* the rules whose glob matches s, the DFA states on the way are built when
+ * first needed */
+unsigned long *globmatch(RuleField *f, const char *s) {
+    int i, j, n, cur, next;
+    unsigned int flushes;
+    const unsigned char *p;
+    GlobState *st;
+
+    if(f->start < 0) {
+        memcpy(f->tmp, f->starts, f->nstarts * sizeof *f->tmp);
+        f->start = globstate(f, f->tmp, f->nstarts);
+    }
+    for(cur = f->start, p = (const unsigned char *)s; *p && f->states[cur].npos; p++, cur = next) {
+        if((next = f->states[cur].next[*p]) >= 0)
+            continue;
+        st = &f->states[cur];
+        for(i = n = 0; i < st->npos; i++) {
+            j = st->pos[i];
+            if(f->globs[j] == '*')
+                f->tmp[n++] = j;
+            else if(f->globs[j] == '?' || (f->globs[j] && (unsigned char)f->globs[j] == *p))
+                f->tmp[n++] = j + 1;
+        }
+        flushes = f->flushes;
+        next = globstate(f, f->tmp, n);
+        if(f->flushes == flushes) /* else cur is gone */
+            f->states[cur].next[*p] = next;
+    }
+    return f->states[cur].match;
+}
+
+/* the DFA state for a set of glob positions, where a star may also match
+ * nothing; all states are dropped once there are MAX_GLOBSTATES of them */
+int globstate(RuleField *f, int *pos, int npos) {
+    int i, n;
+    GlobState *st;
+
+    /* pos has room for every position of the globs */
+    for(i = n = 0; i < npos; i++)
+        if(!f->mark[pos[i]])
+            f->mark[pos[n++] = pos[i]] = 1;
+    for(i = 0; i < n; i++)
+        if(f->globs[pos[i]] == '*' && !f->mark[pos[i] + 1])
+            f->mark[pos[n++] = pos[i] + 1] = 1;
+    for(i = 0; i < n; i++)
+        f->mark[pos[i]] = 0;
+    qsort(pos, n, sizeof *pos, intcmp);
+    for(i = 0; i < f->nstates; i++)
+        if(f->states[i].npos == n && !memcmp(f->states[i].pos, pos, n * sizeof *pos))
+            return i;
+    if(f->nstates == MAX_GLOBSTATES) {
+        for(i = 0; i < f->nstates; i++) {
+            free(f->states[i].pos);
+            free(f->states[i].match);
+        }
+        f->nstates = 0;
+        f->start = -1;
+        f->flushes++;
+    }
+    st = &f->states[f->nstates];
+    if(!(st->pos = malloc((n + 1) * sizeof *pos)) || !(st->match = calloc(rulewords, sizeof *st->match)))
+        eprint("fatal: could not malloc() %u bytes\n", (n + 1) * sizeof *pos);
+    memcpy(st->pos, pos, n * sizeof *pos);
+    st->npos = n;
+    for(i = 0; i < n; i++)
+        if(!f->globs[pos[i]])
+            SETBIT(st->match, f->globrule[pos[i]]);
+    memset(st->next, -1, sizeof st->next);
+    stats.globstates++;
+    return f->nstates++;
+}
+
 Atom getatomprop(Client *c, Atom prop) {
     int di;
     unsigned long dl;
@@ -406,6 +1145,100 @@ Atom getatomprop(Client *c, Atom prop) {
     return atom;
 }
 
+/* a child spawnchild() started was reaped, failures are logged */
+void childexit(Child *c, int status) {
+    const char *cmd = c->launch ? c->launch->cmd : "child";
+
+    if(WIFEXITED(status) && !WEXITSTATUS(status))
+        return;
+    if(c->launch)
+        c->launch->failures++;
+    if(WIFSIGNALED(status))
+        fprintf(stderr, "calavera-wm: %s (pid %d) killed by signal %d\n",
+                cmd, (int)c->pid, WTERMSIG(status));
+    else
+        fprintf(stderr, "calavera-wm: %s (pid %d) exited with status %d\n",
+                cmd, (int)c->pid, WEXITSTATUS(status));
+}
+
+/* the pending child a new window comes from, by _NET_WM_PID or else by the
+ * startup ID it was given, the properties are only read while one waits */
+Child *childfind(Window w) {
+    int format;
+    unsigned long n, extra;
+    unsigned char *p = NULL;
+    char id[64];
+    long pid = 0;
+    Atom type;
+    Child *c;
+
+    if(!childpending(NULL))
+        return NULL;
+    if(XGetWindowProperty(display, w, netatom[NetWMPid], 0L, 1L, False, XA_CARDINAL,
+                          &type, &format, &n, &extra, &p) == Success && p) {
+        if(n == 1 && format == 32)
+            pid = *(long *)p;
+        XFree(p);
+    }
+    for(c = children; pid && c; c = c->next)
+        if(c->pending && c->pid == pid)
+            return c;
+    if(!gettextprop(w, netatom[NetStartupId], id, sizeof id))
+        return NULL;
+    for(c = children; c; c = c->next)
+        if(c->pending && !strcmp(c->id, id))
+            return c;
+    return NULL;
+}
+
+/* the statistics of a command, NULL once MAX_LAUNCHES commands have some */
+Launch *childlaunch(const char *cmd) {
+    const char *name = strrchr(cmd, '/') ? strrchr(cmd, '/') + 1 : cmd;
+    unsigned int i;
+
+    for(i = 0; i < MAX_LAUNCHES && launches[i].cmd[0]
+        && strncmp(launches[i].cmd, name, sizeof launches[i].cmd - 1); i++);
+    if(i == MAX_LAUNCHES)
+        return NULL;
+    if(!launches[i].cmd[0])
+        snprintf(launches[i].cmd, sizeof launches[i].cmd, "%s", name);
+    return &launches[i];
+}
+
+/* the first window of c is managed, count how long it took */
+void childmapped(Child *c) {
+    long long t = now_ms() - c->start;
+    int i;
+    Launch *l = c->launch;
+
+    c->pending = False;
+    if(!l)
+        return;
+    for(i = 0; i < LAUNCH_BUCKETS - 1 && t >= 16LL << i; i++);
+    l->hist[i]++;
+    l->maps++;
+    l->total += t;
+    l->max = MAX(l->max, t);
+}
+
+/* the first child still waiting for its window, of app's launches unless
+ * NULL, the ones waiting for longer than SPAWN_TIMEOUT stop waiting */
+Child *childpending(const char *app) {
+    long long now = now_ms();
+    Child *c, *found = NULL;
+
+    for(c = children; c; c = c->next) {
+        if(c->pending && now - c->start >= SPAWN_TIMEOUT) {
+            c->pending = False;
+            if(c->launch)
+                c->launch->timeouts++;
+        }
+        if(c->pending && !found && (!app || !strcmp(c->app, app)))
+            found = c;
+    }
+    return found;
+}
+
 void checkotherwm(void) {
     xerrorxlib = XSetErrorHandler(xerrorstart);
     /* this causes an error if some other window manager is running */
@@ -416,9 +1249,43 @@ void checkotherwm(void) {
 }
 
 void cleanup(void) {
+    unsigned int i;
+    Client *c;
+    Geometry *g;
+    Child *ch;
 
     while(themon->thestack)
         unmanage(themon->thestack, False);
+    /* hidden scratchpads are mapped again for whoever manages them next */
+    for(i = 0; i < LENGTH(scratchpads); i++)
+        if((c = scratch[i].c)) {
+            if(c->ishidden)
+                XMapWindow(display, c->win);
+            unmanage(c, False);
+        }
+    if(geomtimer) {
+        canceltimer(geomtimer);
+        geomsave(NULL);
+    }
+    for(i = 0; i < LENGTH(geometry); i++)
+        while((g = geometry[i])) {
+            geometry[i] = g->next;
+            free(g->key);
+            free(g);
+        }
+    while(docks)
+        unmanagedock(docks);
+    stateclose();
+    if(barwin)
+        freebar();
+    if(switchwin)
+        freeswitcher();
+    if(font)
+        XFreeFont(display, font);
+#ifdef COMPOSITOR
+    if(comp.active)
+        compcleanup();
+#endif
     XUngrabKey(display, AnyKey, AnyModifier, root);
     XFreeCursor(display, cursor[CurNormal]);
     XFreeCursor(display, cursor[CurResize]);
@@ -427,132 +1294,1110 @@ void cleanup(void) {
     sync_display();
     XSetInputFocus(display, PointerRoot, RevertToPointerRoot, CurrentTime);
     free(themon);
+    rulefree();
+    freeconfig(&cfg);
+    while((ch = children)) {
+        children = ch->next;
+        free(ch);
+    }
+    free(stacking.wins);
+    free(stacking.want);
+    free(stacking.order);
+    free(stacking.work);
+    memset(&stacking, 0, sizeof stacking);
+    if(inofd >= 0)
+        close(inofd);
+    close(tmrfd);
+    close(sigfd);
+    close(epfd);
 }
 
 void clientmessage(XEvent *e) {
     XClientMessageEvent *cme = &e->xclient;
     Client *c = wintoclient(cme->window);
 
-    if(!c)
+    if(!c || c->ishidden)
         return;
     if(cme->message_type == netatom[NetWMState]) {
         if(cme->data.l[1] == netatom[NetWMFullscreen] || cme->data.l[2] == netatom[NetWMFullscreen])
-            setfullscreen(c, (cme->data.l[0] == 1 /* _NET_WM_STATE_ADD    */
-                              || (cme->data.l[0] == 2 /* _NET_WM_STATE_TOGGLE */ && !c->isfullscreen)));
+            setfullscreen(c, ewmh_statechange(cme->data.l[0], c->isfullscreen));
+        if(cme->data.l[1] == netatom[NetWMAbove] || cme->data.l[2] == netatom[NetWMAbove]) {
+            c->isabove = ewmh_statechange(cme->data.l[0], c->isabove);
+            c->isbelow = c->isbelow && !c->isabove;
+            ewmh_setwmstate(c);
+            restack();
+        }
+        if(cme->data.l[1] == netatom[NetWMBelow] || cme->data.l[2] == netatom[NetWMBelow]) {
+            c->isbelow = ewmh_statechange(cme->data.l[0], c->isbelow);
+            c->isabove = c->isabove && !c->isbelow;
+            ewmh_setwmstate(c);
+            restack();
+        }
+    }
+    else if(cme->message_type == netatom[NetWMMoveResize]) {
+        /* only bottom-right resizing is supported, any edge maps to it */
+        switch(cme->data.l[2]) {
+        case 8:  /* _NET_WM_MOVERESIZE_MOVE */
+            dragstart(c, DragMove, False);
+            break;
+        case 9:  /* _NET_WM_MOVERESIZE_SIZE_KEYBOARD */
+            dragstart(c, DragResize, True);
+            break;
+        case 10: /* _NET_WM_MOVERESIZE_MOVE_KEYBOARD */
+            dragstart(c, DragMove, True);
+            break;
+        case 11: /* _NET_WM_MOVERESIZE_CANCEL */
+            if(drag.c == c)
+                dragstop(True);
+            break;
+        default: /* _NET_WM_MOVERESIZE_SIZE_* */
+            if(cme->data.l[2] >= 0 && cme->data.l[2] < 8)
+                dragstart(c, DragResize, False);
+            break;
+        }
     }
 }
 
-void configure(Client *c) {
-    XConfigureEvent ce;
+#ifdef COMPOSITOR
+/* track a top level window, new windows start on top */
+CompWin *compadd(Window w) {
+    CompWin *cw;
+    XWindowAttributes wa;
 
-    ce.type = ConfigureNotify;
-    ce.display = display;
-    ce.event = c->win;
-    ce.window = c->win;
-    ce.x = c->x;
-    ce.y = c->y;
-    ce.width = c->w;
-    ce.height = c->h;
-    ce.border_width = c->bw;
-    ce.above = None;
-    ce.override_redirect = False;
-    XSendEvent(display, c->win, False, StructureNotifyMask, (XEvent *)&ce);
+    if(w == comp.overlay || compfind(w) || !XGetWindowAttributes(display, w, &wa))
+        return NULL;
+    if(!(cw = calloc(1, sizeof(CompWin))))
+        eprint("fatal: could not malloc() %u bytes\n", sizeof(CompWin));
+    cw->win = w;
+    cw->x = wa.x;
+    cw->y = wa.y;
+    cw->w = wa.width;
+    cw->h = wa.height;
+    cw->bw = wa.border_width;
+    cw->visual = wa.visual;
+    cw->inputonly = wa.class == InputOnly;
+    cw->bypass = -1;
+    cw->next = comp.wins;
+    comp.wins = cw;
+    if(wa.map_state == IsViewable)
+        compmap(cw);
+    return cw;
 }
 
-void configurenotify(XEvent *e) {
-    XConfigureEvent *ev = &e->xconfigure;
-    Bool dirty;
+/* the root pixmap set by wallpaper tools, black without one */
+void compbackground(void) {
+    int format;
+    unsigned long n, extra;
+    unsigned char *p = NULL;
+    Atom real;
+    Pixmap pixmap = None;
+    XRenderPictureAttributes pa;
+    XRenderColor black = { 0, 0, 0, 0xffff };
+
+    if(comp.background)
+        XRenderFreePicture(display, comp.background);
+    if(XGetWindowProperty(display, root, comp.rootpmap, 0L, 1L,
+                          False, XA_PIXMAP, &real, &format, &n, &extra, &p) == Success && p) {
+        if(n == 1)
+            pixmap = *(Pixmap *)p;
+        XFree(p);
+    }
+    if(pixmap) {
+        pa.repeat = True;
+        comp.background = XRenderCreatePicture(display, pixmap, comp.format, CPRepeat, &pa);
+    }
+    else
+        comp.background = XRenderCreateSolidFill(display, &black);
+}
 
-    // TODO: updategeom handling sucks, needs to be simplified
-    if(ev->window == root) {
-        dirty = (screen_w != ev->width || screen_h != ev->height);
-        screen_w = ev->width;
-        screen_h = ev->height;
-        if(updategeom() || dirty) {
-            focus(NULL);
-            arrange_windows();
+/* a fullscreen client on top of everything goes to the screen directly */
+void compbypass(void) {
+    int format;
+    unsigned long n, extra;
+    unsigned char *p = NULL;
+    Atom real;
+    Client *c = themon->thesel;
+    CompWin *cw;
+
+    for(cw = comp.wins; cw && (!cw->mapped || cw->inputonly); cw = cw->next);
+    if(!c || !c->isfullscreen || !cw || cw->win != c->win
+       || cw->x > themon->mx || cw->y > themon->my
+       || cw->x + WIDTH(cw) < themon->mx + themon->mw
+       || cw->y + HEIGHT(cw) < themon->my + themon->mh)
+        cw = NULL;
+    else if(cw->bypass < 0) {
+        cw->bypass = 0;
+        if(XGetWindowProperty(display, cw->win, comp.bypassatom, 0L, 1L, False, XA_CARDINAL,
+                              &real, &format, &n, &extra, &p) == Success && p) {
+            if(n == 1)
+                cw->bypass = *(long *)p;
+            XFree(p);
         }
     }
+    /* 1 asks for the bypass, 2 asks to stay composited */
+    if(cw && cw->bypass != 1 && (cw->bypass == 2 || !UNREDIRECT_FULLSCREEN))
+        cw = NULL;
+    if((cw ? cw->win : None) == comp.bypass)
+        return;
+    if(comp.bypass)
+        compredirect();
+    if(cw)
+        compunredirect(cw);
 }
 
-void configurerequest(XEvent *e) {
-    Client *c;
-    XConfigureRequestEvent *ev = &e->xconfigurerequest;
-    XWindowChanges wc;
+void compcleanup(void) {
+    while(comp.wins)
+        compremove(comp.wins);
+    XCompositeUnredirectSubwindows(display, root, CompositeRedirectManual);
+    XRenderFreePicture(display, comp.background);
+    XRenderFreePicture(display, comp.buffer);
+    XRenderFreePicture(display, comp.target);
+    XFreePixmap(display, comp.bufpix);
+    XCompositeReleaseOverlayWindow(display, root);
+    XDestroyWindow(display, comp.cmowner);
+    free(comp.dam);
+    comp.active = False;
+}
 
-    if((c = wintoclient(ev->window))) {
-        if(ev->value_mask & CWBorderWidth)
-            c->bw = ev->border_width;
-        else if(c->isfloating) {
-            if(ev->value_mask & CWX) {
-                c->oldx = c->x;
-                c->x = themon->mx + ev->x;
-            }
-            if(ev->value_mask & CWY) {
-                c->oldy = c->y;
-                c->y = themon->my + ev->y;
-            }
-            if(ev->value_mask & CWWidth) {
-                c->oldw = c->w;
-                c->w = ev->width;
-            }
-            if(ev->value_mask & CWHeight) {
-                c->oldh = c->h;
-                c->h = ev->height;
-            }
-            if((c->x + c->w) > themon->mx + themon->mw && c->isfloating)
-                c->x = themon->mx + (themon->mw / 2 - WIDTH(c) / 2); /* center in x direction */
-            if((c->y + c->h) > themon->my + themon->mh && c->isfloating)
-                c->y = themon->my + (themon->mh / 2 - HEIGHT(c) / 2); /* center in y direction */
-            if((ev->value_mask & (CWX|CWY)) && !(ev->value_mask & (CWWidth|CWHeight)))
-                configure(c);
-            if(c)
-                XMoveResizeWindow(display, c->win, c->x, c->y, c->w, c->h);
-        }
-        else
-            configure(c);
+void compconfigure(XConfigureEvent *ev) {
+    CompWin *cw;
+    Bool resized;
+
+    if(ev->window == root) {
+        compresize();
+        return;
     }
-    else {
-        wc.x = ev->x;
-        wc.y = ev->y;
-        wc.width = ev->width;
-        wc.height = ev->height;
-        wc.border_width = ev->border_width;
-        wc.sibling = ev->above;
-        wc.stack_mode = ev->detail;
-        XConfigureWindow(display, ev->window, ev->value_mask, &wc);
+    if(!(cw = compfind(ev->window)))
+        return;
+    if(cw->mapped)
+        compdamage(cw->x, cw->y, WIDTH(cw), HEIGHT(cw));
+    resized = cw->w != ev->width || cw->h != ev->height || cw->bw != ev->border_width;
+    cw->x = ev->x;
+    cw->y = ev->y;
+    cw->w = ev->width;
+    cw->h = ev->height;
+    cw->bw = ev->border_width;
+    comprestack(cw, ev->above);
+    if(cw->mapped && resized) { /* the named pixmap has the old size */
+        compunmap(cw);
+        compmap(cw);
     }
-    sync_display();
+    else if(cw->mapped)
+        compdamage(cw->x, cw->y, WIDTH(cw), HEIGHT(cw));
 }
 
-Monitor *createmon(void) {
-    Monitor *m;
-
-    if(!(m = (Monitor *)calloc(1, sizeof(Monitor))))
-        eprint("fatal: could not malloc() %u bytes\n", sizeof(Monitor));
-    return m;
+void compdamage(int x, int y, int w, int h) {
+    if(comp.ndam == comp.maxdam) {
+        comp.maxdam = comp.maxdam ? 2 * comp.maxdam : 64;
+        if(!(comp.dam = realloc(comp.dam, comp.maxdam * sizeof *comp.dam)))
+            eprint("fatal: could not realloc() %u bytes\n", comp.maxdam * sizeof *comp.dam);
+    }
+    comp.dam[comp.ndam].x = MAX(x, -32768);
+    comp.dam[comp.ndam].y = MAX(y, -32768);
+    comp.dam[comp.ndam].width = MIN(w, 65535);
+    comp.dam[comp.ndam].height = MIN(h, 65535);
+    comp.ndam++;
 }
 
-void destroynotify(XEvent *e) {
-    Client *c;
-    XDestroyWindowEvent *ev = &e->xdestroywindow;
-
+/* structure events on root children and damage, before the WM's handlers */
+void compevent(XEvent *e) {
+    CompWin *cw;
+    XDamageNotifyEvent *de;
+
+    /* clients select StructureNotify too, only the copies sent to root count */
+    switch(e->type) {
+    case CreateNotify:
+        if(e->xcreatewindow.parent == root)
+            compadd(e->xcreatewindow.window);
+        break;
+    case ConfigureNotify:
+        if(e->xconfigure.event == root)
+            compconfigure(&e->xconfigure);
+        break;
+    case MapNotify:
+        if(e->xmap.event == root && (cw = compfind(e->xmap.window)) && !cw->mapped)
+            compmap(cw);
+        break;
+    case UnmapNotify:
+        if(e->xunmap.event == root && (cw = compfind(e->xunmap.window)) && cw->mapped)
+            compunmap(cw);
+        break;
+    case DestroyNotify:
+        if(e->xdestroywindow.event == root && (cw = compfind(e->xdestroywindow.window)))
+            compremove(cw);
+        break;
+    case ReparentNotify:
+        if(e->xreparent.event != root)
+            break;
+        if(e->xreparent.parent == root)
+            compadd(e->xreparent.window);
+        else if((cw = compfind(e->xreparent.window)))
+            compremove(cw);
+        break;
+    case CirculateNotify:
+        if(e->xcirculate.event == root && (cw = compfind(e->xcirculate.window)))
+            comprestack(cw, e->xcirculate.place == PlaceOnTop ? root : None);
+        break;
+    case Expose:
+        if(e->xexpose.window == comp.overlay)
+            compdamage(e->xexpose.x, e->xexpose.y, e->xexpose.width, e->xexpose.height);
+        break;
+    case PropertyNotify:
+        if(e->xproperty.window == root && e->xproperty.atom == comp.rootpmap) {
+            compbackground();
+            compdamage(0, 0, screen_w, screen_h);
+        }
+        else if(e->xproperty.atom == comp.bypassatom && (cw = compfind(e->xproperty.window)))
+            cw->bypass = -1;
+        break;
+    default:
+        if(e->type != comp.damageev + XDamageNotify)
+            break;
+        de = (XDamageNotifyEvent *)e;
+        if((cw = compfind(de->drawable)) && cw->mapped) {
+            /* the bounding box of the window's damage so far, inside the border */
+            compdamage(cw->x + cw->bw + de->area.x, cw->y + cw->bw + de->area.y,
+                       de->area.width, de->area.height);
+            cw->damaged = cw->thumbdirty = True;
+        }
+        break;
+    }
+}
+
+/* windows die while we still draw them, errors about them don't matter */
+Bool comperror(XErrorEvent *ee) {
+    unsigned int i;
+
+    if(!comp.active)
+        return False;
+    if(ee->request_code == X_FreePixmap && ee->error_code == BadPixmap)
+        return True;
+    for(i = 0; i < LENGTH(comp.opcodes); i++)
+        if(ee->request_code == comp.opcodes[i])
+            return True;
+    return False;
+}
+
+CompWin *compfind(Window w) {
+    CompWin *cw;
+
+    for(cw = comp.wins; cw && cw->win != w; cw = cw->next);
+    return cw;
+}
+
+/* redirect the top level windows if nobody else composites */
+void compinit(void) {
+    int ev, err, major, minor;
+    unsigned int i, n;
+    char name[32];
+    Atom cm;
+    Window d1, d2, *wins = NULL;
+    XserverRegion none;
+    XRenderPictureAttributes pa;
+    static const char *ext[] = { COMPOSITE_NAME, DAMAGE_NAME, XFIXES_NAME, RENDER_NAME };
+
+    for(i = 0; i < LENGTH(ext); i++)
+        if(!XQueryExtension(display, ext[i], &comp.opcodes[i], &ev, &err)) {
+            fprintf(stderr, "calavera-wm: no %s extension, not compositing\n", ext[i]);
+            return;
+        }
+    major = 0;
+    minor = 2;
+    XCompositeQueryVersion(display, &major, &minor);
+    if(major == 0 && minor < 2) {
+        fprintf(stderr, "calavera-wm: Composite %d.%d is too old, not compositing\n", major, minor);
+        return;
+    }
+    XDamageQueryExtension(display, &comp.damageev, &err);
+    XDamageQueryVersion(display, &major, &minor);
+    XFixesQueryVersion(display, &major, &minor);
+    snprintf(name, sizeof name, "_NET_WM_CM_S%d", screen);
+    cm = XInternAtom(display, name, False);
+    if(XGetSelectionOwner(display, cm) != None) {
+        fprintf(stderr, "calavera-wm: another compositing manager is running\n");
+        return;
+    }
+    comp.cmowner = XCreateSimpleWindow(display, root, 0, 0, 1, 1, 0, 0, 0);
+    XSetSelectionOwner(display, cm, comp.cmowner, CurrentTime);
+
+    comp.rootpmap = XInternAtom(display, "_XROOTPMAP_ID", False);
+    comp.bypassatom = XInternAtom(display, "_NET_WM_BYPASS_COMPOSITOR", False);
+    comp.overlay = XCompositeGetOverlayWindow(display, root);
+    none = XFixesCreateRegion(display, NULL, 0);
+    XFixesSetWindowShapeRegion(display, comp.overlay, ShapeInput, 0, 0, none);
+    XFixesDestroyRegion(display, none);
+    XSelectInput(display, comp.overlay, ExposureMask);
+    comp.format = XRenderFindVisualFormat(display, DefaultVisual(display, screen));
+    pa.subwindow_mode = IncludeInferiors;
+    comp.target = XRenderCreatePicture(display, comp.overlay, comp.format, CPSubwindowMode, &pa);
+    comp.active = True;
+    compbackground();
+    compresize();
+
+    XGrabServer(display);
+    XCompositeRedirectSubwindows(display, root, CompositeRedirectManual);
+    if(XQueryTree(display, root, &d1, &d2, &wins, &n)) {
+        for(i = 0; i < n; i++) /* bottom to top */
+            compadd(wins[i]);
+        if(wins)
+            XFree(wins);
+    }
+    XUngrabServer(display);
+}
+
+void compmap(CompWin *cw) {
+    XRenderPictFormat *format;
+    XRenderPictureAttributes pa;
+
+    cw->mapped = True;
+    if(cw->inputonly || cw->unredirected)
+        return;
+    format = XRenderFindVisualFormat(display, cw->visual);
+    cw->argb = format && format->type == PictTypeDirect && format->direct.alphaMask;
+    cw->format = format ? format : comp.format;
+    cw->pixmap = XCompositeNameWindowPixmap(display, cw->win);
+    pa.subwindow_mode = IncludeInferiors;
+    cw->pict = XRenderCreatePicture(display, cw->pixmap, cw->format, CPSubwindowMode, &pa);
+    cw->thumbdirty = True;
+    cw->damage = XDamageCreate(display, cw->win, XDamageReportBoundingBox);
+    compdamage(cw->x, cw->y, WIDTH(cw), HEIGHT(cw));
+}
+
+/* repaint the damaged region into the back buffer and copy it to the overlay */
+void comppaint(void) {
+    int i, ncover = 0, x1, y1, x2, y2;
+    long long start = now_us(), t;
+    XRectangle box, r, cover[64];
+    XserverRegion all, region, ext;
+    CompWin *cw, *argb = NULL;
+
+    if(comp.bypass) { /* nothing of ours is visible */
+        comp.ndam = 0;
+        return;
+    }
+    x1 = y1 = INT_MAX;
+    x2 = y2 = INT_MIN;
+    for(i = 0; i < comp.ndam; i++) {
+        x1 = MIN(x1, comp.dam[i].x);
+        y1 = MIN(y1, comp.dam[i].y);
+        x2 = MAX(x2, comp.dam[i].x + comp.dam[i].width);
+        y2 = MAX(y2, comp.dam[i].y + comp.dam[i].height);
+        stats.framearea += (long long)comp.dam[i].width * comp.dam[i].height;
+    }
+    box.x = x1;
+    box.y = y1;
+    box.width = x2 - x1;
+    box.height = y2 - y1;
+    all = XFixesCreateRegion(display, comp.dam, comp.ndam);
+    region = XFixesCreateRegion(display, comp.dam, comp.ndam);
+    comp.ndam = 0;
+
+    /* top down, each opaque window hides what is under it */
+    for(cw = comp.wins; cw; cw = cw->next) {
+        if(!cw->pict)
+            continue;
+        if(cw->damaged) {
+            XDamageSubtract(display, cw->damage, None, None);
+            cw->damaged = False;
+        }
+        r.x = cw->x;
+        r.y = cw->y;
+        r.width = WIDTH(cw);
+        r.height = HEIGHT(cw);
+        for(i = 0; i < ncover; i++)
+            if(r.x >= cover[i].x && r.y >= cover[i].y
+               && r.x + r.width <= cover[i].x + cover[i].width
+               && r.y + r.height <= cover[i].y + cover[i].height)
+                break;
+        if(i < ncover || r.x >= box.x + box.width || r.y >= box.y + box.height
+           || r.x + r.width <= box.x || r.y + r.height <= box.y) {
+            stats.culled++;
+            continue;
+        }
+        if(cw->argb) {
+            cw->clip = XFixesCreateRegion(display, NULL, 0);
+            XFixesCopyRegion(display, cw->clip, region);
+            cw->argbnext = argb;
+            argb = cw;
+            continue;
+        }
+        XFixesSetPictureClipRegion(display, comp.buffer, 0, 0, region);
+        XRenderComposite(display, PictOpSrc, cw->pict, None, comp.buffer,
+                         0, 0, 0, 0, r.x, r.y, r.width, r.height);
+        ext = XFixesCreateRegion(display, &r, 1);
+        XFixesSubtractRegion(display, region, region, ext);
+        XFixesDestroyRegion(display, ext);
+        if(ncover < (int)LENGTH(cover))
+            cover[ncover++] = r;
+    }
+    XFixesSetPictureClipRegion(display, comp.buffer, 0, 0, region);
+    XRenderComposite(display, PictOpSrc, comp.background, None, comp.buffer,
+                     0, 0, 0, 0, 0, 0, screen_w, screen_h);
+    for(cw = argb; cw; cw = cw->argbnext) {
+        XFixesSetPictureClipRegion(display, comp.buffer, 0, 0, cw->clip);
+        XRenderComposite(display, PictOpOver, cw->pict, None, comp.buffer,
+                         0, 0, 0, 0, cw->x, cw->y, WIDTH(cw), HEIGHT(cw));
+        XFixesDestroyRegion(display, cw->clip);
+        cw->clip = None;
+    }
+    XFixesSetPictureClipRegion(display, comp.buffer, 0, 0, None);
+    XFixesSetPictureClipRegion(display, comp.target, 0, 0, all);
+    XRenderComposite(display, PictOpSrc, comp.buffer, None, comp.target,
+                     box.x, box.y, 0, 0, box.x, box.y, box.width, box.height);
+    XFixesDestroyRegion(display, region);
+    XFixesDestroyRegion(display, all);
+    stats.frames++;
+    t = now_us() - start;
+    stats.frametime += t;
+    stats.maxframetime = MAX(stats.maxframetime, t);
+}
+
+/* composite the bypassed window again, the grab keeps others from drawing in between */
+void compredirect(void) {
+    CompWin *cw = compfind(comp.bypass);
+
+    XGrabServer(display);
+    if(cw) {
+        XCompositeRedirectWindow(display, cw->win, CompositeRedirectManual);
+        cw->unredirected = False;
+        if(cw->mapped)
+            compmap(cw);
+    }
+    XFixesSetWindowShapeRegion(display, comp.overlay, ShapeBounding, 0, 0, None);
+    stats.bypasstime += now_ms() - comp.bypassstart;
+    comp.bypass = None;
+    compdamage(0, 0, screen_w, screen_h);
+    comppaint();
+    XUngrabServer(display);
+}
+
+void compremove(CompWin *cw) {
+    CompWin **p;
+
+    if(cw->mapped)
+        compunmap(cw);
+    if(cw->thumb) {
+        XRenderFreePicture(display, cw->thumb);
+        XFreePixmap(display, cw->thumbpix);
+    }
+    for(p = &comp.wins; *p != cw; p = &(*p)->next);
+    *p = cw->next;
+    free(cw);
+}
+
+/* back buffer of screen size, everything is repainted */
+void compresize(void) {
+    if(comp.buffer) {
+        XRenderFreePicture(display, comp.buffer);
+        XFreePixmap(display, comp.bufpix);
+    }
+    comp.bufpix = XCreatePixmap(display, root, screen_w, screen_h, DefaultDepth(display, screen));
+    comp.buffer = XRenderCreatePicture(display, comp.bufpix, comp.format, 0, NULL);
+    compdamage(0, 0, screen_w, screen_h);
+}
+
+/* put cw right above the window above, at the bottom if None, on top if root */
+void comprestack(CompWin *cw, Window above) {
+    CompWin **p;
+
+    if((cw->next ? cw->next->win : None) == above || (above == root && comp.wins == cw))
+        return;
+    for(p = &comp.wins; *p != cw; p = &(*p)->next);
+    *p = cw->next;
+    for(p = &comp.wins; *p && above != root && (above == None || (*p)->win != above);
+        p = &(*p)->next);
+    cw->next = *p;
+    *p = cw;
+    if(cw->mapped)
+        compdamage(cw->x, cw->y, WIDTH(cw), HEIGHT(cw));
+}
+
+/* scale the window's content down into its thumbnail, all on the server */
+void compthumb(CompWin *cw) {
+    double scale = MAX((double)WIDTH(cw) / THUMB_WIDTH, (double)HEIGHT(cw) / THUMB_HEIGHT);
+    XTransform xf = { {
+        { XDoubleToFixed(scale), 0, 0 },
+        { 0, XDoubleToFixed(scale), 0 },
+        { 0, 0, XDoubleToFixed(1) },
+    } };
+    Picture src;
+
+    if(!cw->thumb) {
+        cw->thumbpix = XCreatePixmap(display, root, THUMB_WIDTH, THUMB_HEIGHT,
+                                     DefaultDepth(display, screen));
+        cw->thumb = XRenderCreatePicture(display, cw->thumbpix, comp.format, 0, NULL);
+    }
+    /* a picture of its own, the transform would also apply to frames */
+    src = XRenderCreatePicture(display, cw->pixmap, cw->format, 0, NULL);
+    XRenderSetPictureTransform(display, src, &xf);
+    XRenderSetPictureFilter(display, src, FilterBilinear, NULL, 0);
+    XRenderComposite(display, PictOpSrc, src, None, cw->thumb,
+                     0, 0, 0, 0, 0, 0, THUMB_WIDTH, THUMB_HEIGHT);
+    XRenderFreePicture(display, src);
+    cw->thumbdirty = False;
+    stats.thumbs++;
+}
+
+void compunmap(CompWin *cw) {
+    cw->mapped = False;
+    if(!cw->pict)
+        return;
+    compdamage(cw->x, cw->y, WIDTH(cw), HEIGHT(cw));
+    XRenderFreePicture(display, cw->pict);
+    XFreePixmap(display, cw->pixmap);
+    XDamageDestroy(display, cw->damage);
+    cw->pict = None;
+    cw->pixmap = None;
+    cw->damage = None;
+    cw->damaged = False;
+}
+
+/* the overlay stays above everything, cw is cut out of it */
+void compunredirect(CompWin *cw) {
+    XRectangle r;
+    XserverRegion shape, hole;
+
+    compunmap(cw);
+    cw->mapped = cw->unredirected = True;
+    XCompositeUnredirectWindow(display, cw->win, CompositeRedirectManual);
+    r.x = r.y = 0;
+    r.width = screen_w;
+    r.height = screen_h;
+    shape = XFixesCreateRegion(display, &r, 1);
+    r.x = cw->x;
+    r.y = cw->y;
+    r.width = WIDTH(cw);
+    r.height = HEIGHT(cw);
+    hole = XFixesCreateRegion(display, &r, 1);
+    XFixesSubtractRegion(display, shape, shape, hole);
+    XFixesSetWindowShapeRegion(display, comp.overlay, ShapeBounding, 0, 0, shape);
+    XFixesDestroyRegion(display, hole);
+    XFixesDestroyRegion(display, shape);
+    comp.bypass = cw->win;
+    comp.bypassstart = now_ms();
+    stats.bypasses++;
+}
+#endif
+
+/* resolve what the handlers of a batch asked for: the layout, then a
+ * single focus change and restack however often they were requested */
+void commit(void) {
+    XEvent ev;
+    Client *c = themon->thesel;
+
+    XTRACE_SCOPE("commit()");
+    if(layoutdirty) {
+        layoutdirty = False;
+        showhide(themon->thestack);
+        arrangetiles(themon);
+    }
+    if(focusdirty) {
+        focusdirty = False;
+        if(c != xfocus) {
+            unfocus(xfocus, False);
+            if(c) {
+                grabbuttons(c, True);
+                XSetWindowBorder(display, c->win, cfg.focuscolor);
+            }
+            stats.focusapplied++;
+        }
+        if(c)
+            setfocus(c);
+        else
+            XSetInputFocus(display, root, RevertToPointerRoot, CurrentTime);
+        xfocus = c;
+    }
+    if(stackdirty) {
+        stackdirty = False;
+        if(c)
+            raiseclient(themon, c);
+        if(applystack())
+            stats.restacks++;
+        if(c) {
+            /* drop the crossing events of raising and rearranging */
+            sync_display();
+            while(XCheckMaskEvent(display, EnterWindowMask, &ev));
+        }
+    }
+}
+
+void configure(Client *c) {
+    XConfigureEvent ce;
+
+    ce.type = ConfigureNotify;
+    ce.display = display;
+    ce.event = c->win;
+    ce.window = c->win;
+    ce.x = c->x;
+    ce.y = c->y;
+    ce.width = c->w;
+    ce.height = c->h;
+    ce.border_width = c->bw;
+    ce.above = None;
+    ce.override_redirect = False;
+    XSendEvent(display, c->win, False, StructureNotifyMask, (XEvent *)&ce);
+}
+
+void configurenotify(XEvent *e) {
+    XConfigureEvent *ev = &e->xconfigure;
+    Bool dirty;
+
+    // TODO: updategeom handling sucks, needs to be simplified
+    if(ev->window == root) {
+        dirty = (screen_w != ev->width || screen_h != ev->height);
+        screen_w = ev->width;
+        screen_h = ev->height;
+        if(updategeom() || dirty) {
+            focus(NULL);
+            arrange_windows();
+        }
+    }
+}
+
+void configurerequest(XEvent *e) {
+    Client *c;
+    XConfigureRequestEvent *ev = &e->xconfigurerequest, *n;
+    XWindowChanges wc;
+    XEvent next;
+    Rect old;
+
+    /* coalesce the queued requests of this window, later values win */
+    stats.configreqs++;
+    while(XCheckIfEvent(display, &next, isconfigurerequest, (XPointer)&ev->window)) {
+        n = &next.xconfigurerequest;
+        stats.configreqs++;
+        if(n->value_mask & CWX)
+            ev->x = n->x;
+        if(n->value_mask & CWY)
+            ev->y = n->y;
+        if(n->value_mask & CWWidth)
+            ev->width = n->width;
+        if(n->value_mask & CWHeight)
+            ev->height = n->height;
+        if(n->value_mask & CWBorderWidth)
+            ev->border_width = n->border_width;
+        if(n->value_mask & CWSibling)
+            ev->above = n->above;
+        if(n->value_mask & CWStackMode)
+            ev->detail = n->detail;
+        ev->value_mask |= n->value_mask;
+    }
+    stats.configures++;
+    if((c = wintoclient(ev->window))) {
+        old.x = c->x;
+        old.y = c->y;
+        old.w = WIDTH(c);
+        old.h = HEIGHT(c);
+        if(ev->value_mask & CWBorderWidth)
+            c->bw = ev->border_width;
+        /* a merged request may carry a border and a geometry change */
+        if(c->isfloating && (ev->value_mask & (CWX|CWY|CWWidth|CWHeight))) {
+            if(ev->value_mask & CWX) {
+                c->oldx = c->x;
+                c->x = themon->mx + ev->x;
+            }
+            if(ev->value_mask & CWY) {
+                c->oldy = c->y;
+                c->y = themon->my + ev->y;
+            }
+            if(ev->value_mask & CWWidth) {
+                c->oldw = c->w;
+                c->w = ev->width;
+            }
+            if(ev->value_mask & CWHeight) {
+                c->oldh = c->h;
+                c->h = ev->height;
+            }
+            if((c->x + c->w) > themon->mx + themon->mw && c->isfloating)
+                c->x = themon->mx + (themon->mw / 2 - WIDTH(c) / 2); /* center in x direction */
+            if((c->y + c->h) > themon->my + themon->mh && c->isfloating)
+                c->y = themon->my + (themon->mh / 2 - HEIGHT(c) / 2); /* center in y direction */
+            if((ev->value_mask & (CWX|CWY)) && !(ev->value_mask & (CWWidth|CWHeight)))
+                configure(c);
+            if(c) {
+                XMoveResizeWindow(display, c->win, c->x, c->y, c->w, c->h);
+                placemove(c, &old);
+            }
+        }
+        else
+            configure(c);
+    }
+    else {
+        wc.x = ev->x;
+        wc.y = ev->y;
+        wc.width = ev->width;
+        wc.height = ev->height;
+        wc.border_width = ev->border_width;
+        wc.sibling = ev->above;
+        wc.stack_mode = ev->detail;
+        XConfigureWindow(display, ev->window, ev->value_mask, &wc);
+    }
+    sync_display();
+}
+
+Monitor *createmon(void) {
+    Monitor *m;
+
+    if(!(m = (Monitor *)calloc(1, sizeof(Monitor))))
+        eprint("fatal: could not malloc() %u bytes\n", sizeof(Monitor));
+    m->lt = &layouts[0];
+    m->mfact = MFACT;
+    m->nmaster = NMASTER;
+    m->tilefrom = INT_MAX;
+    return m;
+}
+
+void destroynotify(XEvent *e) {
+    Client *c;
+    Dock *d;
+    XDestroyWindowEvent *ev = &e->xdestroywindow;
+
     if((c = wintoclient(ev->window)))
         unmanage(c, True);
+    else if((d = wintodock(ev->window)))
+        unmanagedock(d);
+}
+
+void defaultconfig(Config *cfg) {
+    cfg->focuscolor = FOCUS;
+    cfg->unfocuscolor = UNFOCUS;
+    cfg->bordersize = BORDER_SIZE;
+    cfg->snap = SNAP;
+    cfg->topsize = TOP_SIZE;
+    cfg->bottomsize = BOTTOM_SIZE;
+    cfg->prefixmod = PREFIX_MODKEY;
+    cfg->prefixkey = PREFIX_KEYSYM;
+    cfg->keys = keys;
+    cfg->nkeys = LENGTH(keys);
+    cfg->buttons = buttons;
+    cfg->nbuttons = LENGTH(buttons);
+    cfg->rules = rules;
+    cfg->nrules = LENGTH(rules);
+    cfg->mem = NULL;
+    cfg->nmem = 0;
+}
+
+int intcmp(const void *a, const void *b) {
+    int ia = *(const int *)a, ib = *(const int *)b;
+
+    return ia < ib ? -1 : ia > ib;
+}
+
+Bool isconfigurerequest(Display *dpy, XEvent *e, XPointer arg) {
+    /* xany.window of a ConfigureRequest is the parent, so match by hand */
+    return e->type == ConfigureRequest && e->xconfigurerequest.window == *(Window *)arg;
+}
+
+void dequeuework(Client *c) {
+    Client **tc, *prev = NULL;
+
+    if(!c->work)
+        return;
+    for(tc = &workhead; *tc && *tc != c; tc = &(*tc)->wnext)
+        prev = *tc;
+    *tc = c->wnext;
+    if(worktail == c)
+        worktail = prev;
+    c->wnext = NULL;
+    c->work = 0;
+}
+
+void dowork(Client *c, unsigned int work) {
+    if(work & WorkHints)
+        updatesizehints(c);
+    if(work & WorkName)
+        updatetitle(c);
+    if(work & WorkClass)
+        updateclass(c);
+    if(work & WorkState)
+        ewmh_setclientstate(c, NormalState);
+}
+
+/* forget pending work of c without doing it, off the queue if none is left */
+void dropwork(Client *c, unsigned int work) {
+    if(c->work & ~work)
+        c->work &= ~work;
+    else
+        dequeuework(c);
+}
+
+/* focus follows mouse: focus a client once the pointer rested on it for
+ * HOVER_DELAY ms, so sweeping across windows doesn't focus each of them */
+void enternotify(XEvent *e) {
+    Client *c;
+    XCrossingEvent *ev = &e->xcrossing;
+
+    if(!FOCUS_FOLLOWS_MOUSE)
+        return;
+    if((ev->mode != NotifyNormal || ev->detail == NotifyInferior) && ev->window != root)
+        return;
+    canceltimer(hovertimer);
+    hovertimer = 0;
+    if(!(c = wintoclient(ev->window)) || c == themon->thesel)
+        return;
+    stats.hovers++;
+    /* the pointer barely moved since the last change, e.g. a window moved under it */
+    if(abs(ev->x_root - focusx) + abs(ev->y_root - focusy) < HOVER_THRESHOLD)
+        return;
+    hoverwin = c->win;
+    hoverx = ev->x_root;
+    hovery = ev->y_root;
+    hovertimer = settimer(HOVER_DELAY, hoverexpire, NULL);
 }
 
-void detach(Client *c) {
-    Client **tc;
+/* bring the segments up to date, copy the ones that changed to the window */
+void drawbar(void) {
+    char text[SegLast][BUFSIZE];
+    int i, len, x[SegLast], w[SegLast], dx1 = INT_MAX, dx2 = 0;
+    long long start = now_us(), t;
+    Client *c;
 
-    for(tc = &themon->clients; *tc && *tc != c; tc = &(*tc)->next);
-    *tc = c->next;
+    /* hidden under a fullscreen client, drawn once it goes */
+    if(themon->thesel && themon->thesel->isfullscreen)
+        return;
+    bardirty = False;
+    if(!barwin)
+        return;
+    snprintf(text[SegLayout], BUFSIZE, "%s", themon->lt->symbol);
+    text[SegClients][0] = '\0';
+    for(len = 0, i = VIEW_NUMBER_MAP, c = themon->clients; c && len < BUFSIZE; c = c->next, i++)
+        len += snprintf(text[SegClients] + len, BUFSIZE - len,
+                        c == themon->thesel ? "[%d]" : " %d ", i);
+    snprintf(text[SegTitle], BUFSIZE, "%s", themon->thesel ? themon->thesel->name : "");
+    snprintf(text[SegStatus], BUFSIZE, "%s", stext);
+    for(i = 0; i < SegLast; i++)
+        w[i] = XTextWidth(font, text[i], strlen(text[i])) + barh;
+    x[SegLayout] = 0;
+    x[SegClients] = w[SegLayout];
+    x[SegTitle] = x[SegClients] + w[SegClients];
+    x[SegStatus] = MAX(x[SegTitle], themon->mw - w[SegStatus]);
+    w[SegTitle] = x[SegStatus] - x[SegTitle];
+    for(i = 0; i < SegLast; i++) {
+        if(segs[i].x == x[i] && segs[i].w == w[i] && !strcmp(segs[i].text, text[i]))
+            continue;
+        memcpy(segs[i].text, text[i], BUFSIZE);
+        segs[i].x = x[i];
+        segs[i].w = w[i];
+        drawsegment(&segs[i], i == SegTitle && themon->thesel ? cfg.focuscolor : BAR_BG);
+        dx1 = MIN(dx1, x[i]);
+        dx2 = MAX(dx2, x[i] + w[i]);
+        stats.barsegs++;
+    }
+    if(dx1 < dx2)
+        XCopyArea(display, barpix, barwin, bargc, dx1, 0, dx2 - dx1, barh, dx1, 0);
+    stats.bardraws++;
+    t = now_us() - start;
+    stats.bartime += t;
+    stats.maxbartime = MAX(stats.maxbartime, t);
+}
+
+/* into the pixmap, the text is cut to fit */
+void drawsegment(Segment *seg, unsigned long bg) {
+    int len = strlen(seg->text);
+
+    XSetForeground(display, bargc, bg);
+    XFillRectangle(display, barpix, bargc, seg->x, 0, seg->w, barh);
+    while(len > 0 && XTextWidth(font, seg->text, len) > seg->w - barh)
+        len--;
+    XSetForeground(display, bargc, BAR_FG);
+    XDrawString(display, barpix, bargc, seg->x + barh / 2, font->ascent + 1, seg->text, len);
+}
+
+/* all clients with the selected one highlighted, as thumbnails when compositing */
+void drawswitcher(void) {
+    char text[BUFSIZE];
+    int i, n, cols, rows, cellw, cellh, fh, w, h, x, y, len;
+    Bool thumbs = False;
+    Client *c;
+    XSetWindowAttributes wa;
+#ifdef COMPOSITOR
+    CompWin *cw;
+
+    thumbs = comp.active;
+#endif
+
+    for(n = 0, c = themon->clients; c; c = c->next)
+        n++;
+    initfont();
+    fh = font->ascent + font->descent + 2;
+    if(thumbs) {
+        cellw = THUMB_WIDTH + fh;
+        cellh = THUMB_HEIGHT + 2 * fh;
+        for(cols = 1; cols * cols < n; cols++);
+        cols = MAX(1, MIN(cols, themon->mw / cellw));
+    }
+    else { /* a text list */
+        cellw = themon->mw / 3;
+        cellh = fh;
+        cols = 1;
+    }
+    rows = MAX(1, MIN((n + cols - 1) / cols, themon->mh / cellh));
+    w = cols * cellw;
+    h = rows * cellh;
+    if(!switchwin) {
+        wa.override_redirect = True;
+        wa.background_pixel = BAR_BG;
+        wa.event_mask = ExposureMask;
+        switchwin = XCreateWindow(display, root, 0, 0, w, h, 0, DefaultDepth(display, screen),
+                                  CopyFromParent, DefaultVisual(display, screen),
+                                  CWOverrideRedirect|CWBackPixel|CWEventMask, &wa);
+        switchgc = XCreateGC(display, root, 0, NULL);
+        XSetFont(display, switchgc, font->fid);
+    }
+    if(w != switchw || h != switchh) {
+        if(switchpix)
+            XFreePixmap(display, switchpix);
+        switchpix = XCreatePixmap(display, root, w, h, DefaultDepth(display, screen));
+#ifdef COMPOSITOR
+        if(switchpict)
+            XRenderFreePicture(display, switchpict);
+        switchpict = thumbs ? XRenderCreatePicture(display, switchpix, comp.format, 0, NULL) : None;
+#endif
+        switchw = w;
+        switchh = h;
+    }
+    XSetForeground(display, switchgc, BAR_BG);
+    XFillRectangle(display, switchpix, switchgc, 0, 0, w, h);
+    for(i = 0, c = themon->clients; c && i < cols * rows; c = c->next, i++) {
+        x = i % cols * cellw;
+        y = i / cols * cellh;
+        if(c == themon->thesel) {
+            XSetForeground(display, switchgc, cfg.focuscolor);
+            XFillRectangle(display, switchpix, switchgc, x, y, cellw, cellh);
+        }
+#ifdef COMPOSITOR
+        /* only thumbnails of windows damaged since they were drawn are redone */
+        if(thumbs && (cw = compfind(c->win))) {
+            if(cw->pict && (cw->thumbdirty || !cw->thumb))
+                compthumb(cw);
+            if(cw->thumb)
+                XRenderComposite(display, PictOpSrc, cw->thumb, None, switchpict, 0, 0, 0, 0,
+                                 x + fh / 2, y + fh / 2, THUMB_WIDTH, THUMB_HEIGHT);
+        }
+#endif
+        snprintf(text, sizeof text, "%d %s", VIEW_NUMBER_MAP + i, c->name);
+        for(len = strlen(text); len > 0 && XTextWidth(font, text, len) > cellw - fh; len--);
+        XSetForeground(display, switchgc, BAR_FG);
+        XDrawString(display, switchpix, switchgc, x + fh / 2, y + cellh - fh + font->ascent + 1,
+                    text, len);
+    }
+    XMoveResizeWindow(display, switchwin, themon->mx + (themon->mw - w) / 2,
+                      themon->my + (themon->mh - h) / 2, w, h);
+    XMapRaised(display, switchwin);
+    XCopyArea(display, switchpix, switchwin, switchgc, 0, 0, w, h, 0, 0);
+    stats.switchers++;
+}
+
+/* keyboard driven drag: arrows or b/f/p/n step, Return ends, Escape restores */
+void dragkey(KeySym keysym) {
+    int dx = 0, dy = 0;
+    Client *c = drag.c;
+
+    switch(keysym) {
+    case XK_Left:  case XK_b: dx = -DRAG_STEP; break;
+    case XK_Right: case XK_f: dx = DRAG_STEP; break;
+    case XK_Up:    case XK_p: dy = -DRAG_STEP; break;
+    case XK_Down:  case XK_n: dy = DRAG_STEP; break;
+    case XK_Return:
+        dragstop(False);
+        return;
+    case XK_Escape:
+        dragstop(True);
+        return;
+    default:
+        return;
+    }
+    if(drag.type == DragMove)
+        dragmotion(drag.px + c->x - drag.ox + dx, drag.py + c->y - drag.oy + dy);
+    else
+        dragmotion(c->x + c->w + 2 * c->bw - 1 + dx, c->y + c->h + 2 * c->bw - 1 + dy);
+}
+
+/* pointer (or the keyboard equivalent) is at x, y in root coordinates */
+void dragmotion(int x, int y) {
+    int nx, ny, nw, nh;
+    Client *c = drag.c;
+
+    if(drag.type == DragMove) {
+        nx = drag.ox + (x - drag.px);
+        ny = drag.oy + (y - drag.py);
+        snaptoarea(themon, c, &nx, &ny, cfg.snap);
+        if(!c->isfloating && (abs(nx - c->x) > cfg.snap || abs(ny - c->y) > cfg.snap))
+            setfloating(c, True);
+        if(c->isfloating)
+            resize(c, nx, ny, c->w, c->h, True);
+    }
+    else {
+        nw = MAX(x - drag.ox - 2 * c->bw + 1, 1);
+        nh = MAX(y - drag.oy - 2 * c->bw + 1, 1);
+        if(!c->isfloating && (abs(nw - c->w) > cfg.snap || abs(nh - c->h) > cfg.snap))
+            setfloating(c, True);
+        if(c->isfloating)
+            resize(c, c->x, c->y, nw, nh, True);
+    }
+}
+
+/* enter the drag state, mouse, keyboard and _NET_WM_MOVERESIZE all start here */
+void dragstart(Client *c, int type, Bool keyboard) {
+    if(!c || drag.type != DragNone)
+        return;
+    if(c->isfullscreen) /* no support moving or resizing fullscreen windows */
+        return;
+    if(c != themon->thesel)
+        focus(c);
+    restack();
+    drag.c = c;
+    drag.keyboard = keyboard;
+    drag.ox = c->x;
+    drag.oy = c->y;
+    drag.ow = c->w;
+    drag.oh = c->h;
+    if(keyboard) {
+        if(XGrabKeyboard(display, root, False, GrabModeAsync, GrabModeAsync,
+                         CurrentTime) != GrabSuccess)
+            return;
+        drag.px = c->x + c->w / 2;
+        drag.py = c->y + c->h / 2;
+    }
+    else {
+        if(type == DragMove) /* Warp pointer to center on move */
+            XWarpPointer(display, None, c->win, 0, 0, 0, 0, c->w / 2, c->h / 2);
+        if(XGrabPointer(display, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
+                        None, cursor[type == DragMove ? CurMove : CurResize],
+                        CurrentTime) != GrabSuccess)
+            return;
+        /* When resizing warp pointer to left-right corner */
+        if(type == DragResize)
+            XWarpPointer(display, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
+        if(!getrootptr(&drag.px, &drag.py)) {
+            XUngrabPointer(display, CurrentTime);
+            return;
+        }
+    }
+    drag.type = type;
 }
 
-void detachstack(Client *c) {
-    Client **tc;
+/* leave the drag state, restore puts the client back where it started */
+void dragstop(Bool restore) {
+    XEvent ev;
+    Client *c = drag.c;
 
-    for(tc = &themon->thestack; *tc && *tc != c; tc = &(*tc)->snext);
-    *tc = c->snext;
+    if(drag.type == DragNone)
+        return;
+    if(c && restore)
+        resize(c, drag.ox, drag.oy, drag.ow, drag.oh, True);
+    else if(c)
+        geomremember(c);
+    if(drag.keyboard)
+        XUngrabKeyboard(display, CurrentTime);
+    else {
+        if(c && drag.type == DragResize)
+            XWarpPointer(display, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
+        XUngrabPointer(display, CurrentTime);
+    }
+    drag.type = DragNone;
+    drag.c = NULL;
+    while(XCheckMaskEvent(display, EnterWindowMask, &ev));
 }
 
 void eprint(const char *errstr, ...) {
@@ -571,6 +2416,8 @@ void ewmh_init(void) {
     wmatom[WMDelete] = XInternAtom(display, "WM_DELETE_WINDOW", False);
     wmatom[WMState] = XInternAtom(display, "WM_STATE", False);
     wmatom[WMTakeFocus] = XInternAtom(display, "WM_TAKE_FOCUS", False);
+    wmatom[WMSnapshot] = XInternAtom(display, "_CALAVERA_WM_SNAPSHOT", False);
+    wmatom[WMRole] = XInternAtom(display, "WM_WINDOW_ROLE", False);
 
     /* EWMH */
     netatom[NetSupported] = XInternAtom(display, "_NET_SUPPORTED", False);
@@ -578,27 +2425,81 @@ void ewmh_init(void) {
     /* STATES */
     netatom[NetWMState] = XInternAtom(display, "_NET_WM_STATE", False);
     netatom[NetWMFullscreen] = XInternAtom(display, "_NET_WM_STATE_FULLSCREEN", False);
+    netatom[NetWMAbove] = XInternAtom(display, "_NET_WM_STATE_ABOVE", False);
+    netatom[NetWMBelow] = XInternAtom(display, "_NET_WM_STATE_BELOW", False);
+    netatom[NetWMMoveResize] = XInternAtom(display, "_NET_WM_MOVERESIZE", False);
+
+    /* DOCKS */
+    netatom[NetWMStrut] = XInternAtom(display, "_NET_WM_STRUT", False);
+    netatom[NetWMStrutPartial] = XInternAtom(display, "_NET_WM_STRUT_PARTIAL", False);
+    netatom[NetWMWindowType] = XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
+    netatom[NetWMWindowTypeDock] = XInternAtom(display, "_NET_WM_WINDOW_TYPE_DOCK", False);
+    netatom[NetWorkarea] = XInternAtom(display, "_NET_WORKAREA", False);
 
     /* CLIENTS */
     netatom[NetWMName] = XInternAtom(display, "_NET_WM_NAME", False);
+    netatom[NetWMPid] = XInternAtom(display, "_NET_WM_PID", False);
+    netatom[NetStartupId] = XInternAtom(display, "_NET_STARTUP_ID", False);
+    netatom[NetClientListStacking] = XInternAtom(display, "_NET_CLIENT_LIST_STACKING", False);
+
+    XChangeProperty(display, root, netatom[NetSupported], XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)netatom, NetLast);
 }
 
+/* run the pending work of c that the caller depends on right now */
+void flushwork(Client *c, unsigned int work) {
+    if(!(work &= c->work))
+        return;
+    if(c->work & ~work)
+        c->work &= ~work;
+    else
+        dequeuework(c);
+    stats.workforced++;
+    dowork(c, work);
+}
+
+/* select c or, if NULL, the most recently focused client, commit() tells the server */
 void focus(Client *c) {
+    XTRACE_SCOPE("focus()");
     if(!c)
         c = themon->thestack;
-    if(themon->thesel && themon->thesel != c);
-        unfocus(themon->thesel, False);
+    if(c != themon->thesel)
+        stats.focus++;
     if(c) {
-        detachstack(c);
-        attachstack(c);
-        grabbuttons(c, True);
-        XSetWindowBorder(display, c->win, FOCUS);
-        setfocus(c);
-    }
-    else {
-        XSetInputFocus(display, root, RevertToPointerRoot, CurrentTime);
+        detachstack(themon, c);
+        attachstack(themon, c);
     }
     themon->thesel = c;
+    focusdirty = True;
+    bardirty = True;
+}
+
+void expose(XEvent *e) {
+    XExposeEvent *ev = &e->xexpose;
+
+    if(ev->window == barwin)
+        XCopyArea(display, barpix, barwin, bargc, ev->x, ev->y, ev->width, ev->height, ev->x, ev->y);
+    else if(ev->window == switchwin)
+        XCopyArea(display, switchpix, switchwin, switchgc, ev->x, ev->y, ev->width, ev->height,
+                  ev->x, ev->y);
+}
+
+void freebar(void) {
+    XFreePixmap(display, barpix);
+    XFreeGC(display, bargc);
+    XDestroyWindow(display, barwin);
+    barwin = None;
+}
+
+void freeswitcher(void) {
+#ifdef COMPOSITOR
+    if(switchpict)
+        XRenderFreePicture(display, switchpict);
+#endif
+    XFreePixmap(display, switchpix);
+    XFreeGC(display, switchgc);
+    XDestroyWindow(display, switchwin);
+    switchwin = None;
 }
 
 void focusin(XEvent *e) { /* there are some broken focus acquiring clients */
@@ -608,28 +2509,36 @@ void focusin(XEvent *e) { /* there are some broken focus acquiring clients */
         setfocus(themon->thesel);
 }
 
+void freeconfig(Config *cfg) {
+    unsigned int i;
+
+    for(i = 0; i < cfg->nmem; i++)
+        free(cfg->mem[i]);
+    free(cfg->mem);
+    cfg->mem = NULL;
+    cfg->nmem = 0;
+}
+
 void switcher(const Arg *arg) {
-    Client *c = NULL, *i;
+    Client *c;
 
-    if(!themon->thesel)
-        return;
-    if (arg->i > 0) { /* next */
-        if(!(c = themon->thesel->next))
-            c = themon->clients;
-    }
-    else {  /* prev */
-        for(i = themon->clients; i != themon->thesel; i = i->next)
-            c = i;
-        if(!c)
-            for(; i; i = i->next)
-                c = i;
-    }
-    if(c) {
+    XTRACE_SCOPE("switcher()");
+    if((c = nextclient(themon, arg->i))) {
         focus(c);
         restack();
+        if(SWITCHER_OVERLAY) {
+            drawswitcher();
+            canceltimer(switchtimer);
+            switchtimer = settimer(SWITCHER_DELAY, switcherexpire, NULL);
+        }
     }
 }
 
+void switcherexpire(void *arg) {
+    switchtimer = 0;
+    XUnmapWindow(display, switchwin);
+}
+
 Bool getrootptr(int *x, int *y) {
     int di;
     unsigned int dui;
@@ -638,6 +2547,27 @@ Bool getrootptr(int *x, int *y) {
     return XQueryPointer(display, root, &dummy, &dummy, x, y, &di, &di, &dui);
 }
 
+Bool gettextprop(Window w, Atom atom, char *text, unsigned int size) {
+    char **list = NULL;
+    int n;
+    XTextProperty name;
+
+    if(!text || size == 0)
+        return False;
+    text[0] = '\0';
+    if(!XGetTextProperty(display, w, &name, atom) || !name.nitems)
+        return False;
+    if(name.encoding == XA_STRING)
+        strncpy(text, (char *)name.value, size - 1);
+    else if(XmbTextPropertyToTextList(display, &name, &list, &n) >= Success && n > 0 && *list) {
+        strncpy(text, *list, size - 1);
+        XFreeStringList(list);
+    }
+    text[size - 1] = '\0';
+    XFree(name.value);
+    return True;
+}
+
 long ewmh_getstate(Window w) {
     int format;
     long result = -1;
@@ -654,6 +2584,23 @@ long ewmh_getstate(Window w) {
     return result;
 }
 
+/* left, right, top and bottom of a strut property */
+Bool getstrut(Window w, Atom prop, long *strut) {
+    int i, format;
+    unsigned long n, extra;
+    unsigned char *p = NULL;
+    Atom real;
+
+    if(XGetWindowProperty(display, w, prop, 0L, 4L, False, XA_CARDINAL,
+                          &real, &format, &n, &extra, &p) != Success)
+        return False;
+    if(n == 4)
+        for(i = 0; i < 4; i++)
+            strut[i] = ((long *)p)[i];
+    XFree(p);
+    return n == 4;
+}
+
 void grab_pointer() {
     XGrabPointer (display, root, True, 0,
                   GrabModeAsync, GrabModeAsync,
@@ -661,16 +2608,15 @@ void grab_pointer() {
 }
 
 void grabbuttons(Client *c, Bool focused) {
-    updatenumlockmask();
     {
         unsigned int i, j;
         unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
         XUngrabButton(display, AnyButton, AnyModifier, c->win);
         if(focused) {
-            for(i = 0; i < LENGTH(buttons); i++)
+            for(i = 0; i < cfg.nbuttons; i++)
                 for(j = 0; j < LENGTH(modifiers); j++)
-                    XGrabButton(display, buttons[i].button,
-                                buttons[i].mask | modifiers[j],
+                    XGrabButton(display, cfg.buttons[i].button,
+                                cfg.buttons[i].mask | modifiers[j],
                                 c->win, False, BUTTONMASK,
                                 GrabModeAsync, GrabModeSync, None, None);
         }
@@ -705,9 +2651,9 @@ void grabkeys(int keytype) {
             XWarpPointer(display, None, root, 0, 0, 0, 0, screen_w, screen_h);
         }
 
-        if((code = XKeysymToKeycode(display, PREFIX_KEYSYM)))
+        if((code = XKeysymToKeycode(display, cfg.prefixkey)))
             for(i = 0; i < LENGTH(modifiers); i++)
-                XGrabKey(display, code, PREFIX_MODKEY | modifiers[i],
+                XGrabKey(display, code, cfg.prefixmod | modifiers[i],
                          root, True, GrabModeAsync,
                          GrabModeAsync);
 
@@ -715,6 +2661,62 @@ void grabkeys(int keytype) {
     }
 }
 
+/* does c cover some of the old work area that is outside the current one */
+Bool inlostarea(Client *c, int ox, int oy, int ow, int oh) {
+    int x1 = MAX(c->x, ox), y1 = MAX(c->y, oy);
+    int x2 = MIN(c->x + WIDTH(c), ox + ow), y2 = MIN(c->y + HEIGHT(c), oy + oh);
+
+    if(x1 >= x2 || y1 >= y2)
+        return False;
+    return x1 < themon->wx || y1 < themon->wy
+           || x2 > themon->wx + themon->ww || y2 > themon->wy + themon->wh;
+}
+
+/* _NET_WM_WINDOW_TYPE_DOCK windows reserve space instead of being managed */
+Bool isdock(Window w) {
+    int format;
+    unsigned long i, n, extra;
+    unsigned char *p = NULL;
+    Atom real;
+    Bool dock = False;
+
+    if(XGetWindowProperty(display, w, netatom[NetWMWindowType], 0L, 8L, False, XA_ATOM,
+                          &real, &format, &n, &extra, &p) != Success)
+        return False;
+    for(i = 0; i < n && !dock; i++)
+        dock = ((Atom *)p)[i] == netatom[NetWMWindowTypeDock];
+    XFree(p);
+    return dock;
+}
+
+void initbar(void) {
+    XSetWindowAttributes wa;
+
+    initfont();
+    barh = font->ascent + font->descent + 2;
+    wa.override_redirect = True;
+    wa.background_pixel = BAR_BG;
+    wa.event_mask = ExposureMask;
+    wa.cursor = cursor[CurNormal];
+    barwin = XCreateWindow(display, root, themon->mx, themon->my, themon->mw, barh, 0,
+                           DefaultDepth(display, screen), CopyFromParent, DefaultVisual(display, screen),
+                           CWOverrideRedirect|CWBackPixel|CWEventMask|CWCursor, &wa);
+    bargc = XCreateGC(display, root, 0, NULL);
+    XSetFont(display, bargc, font->fid);
+    updatebarpos();
+    if(!gettextprop(root, XA_WM_NAME, stext, sizeof stext))
+        snprintf(stext, sizeof stext, "calavera-wm-%s", VERSION);
+    XMapRaised(display, barwin);
+}
+
+void initfont(void) {
+    if(font)
+        return;
+    if(!(font = XLoadQueryFont(display, BAR_FONT))
+       && !(font = XLoadQueryFont(display, "fixed")))
+        eprint("calavera-wm: cannot load font %s\n", BAR_FONT);
+}
+
 void init_cursors() {
     cursor[CurNormal] = XCreateFontCursor(display, CURSOR);
     cursor[CurResize] = XCreateFontCursor(display, XC_bottom_right_corner);
@@ -722,35 +2724,193 @@ void init_cursors() {
     cursor[CurCmd] = XCreateFontCursor(display, CURSOR_WAITKEY);
 }
 
-void handle_events(void) {
+/* rows of equal columns, the last row takes what is left */
+void grid(Monitor *m, int n, int i, int *x, int *y, int *w, int *h) {
+    int cols, rows, row, col, ncols;
+
+    for(cols = 1; cols * cols < n; cols++);
+    rows = (n + cols - 1) / cols;
+    row = i / cols;
+    col = i % cols;
+    ncols = row == rows - 1 ? n - row * cols : cols;
+    *w = m->ww / ncols;
+    *h = m->wh / rows;
+    *x = m->wx + col * *w;
+    *y = m->wy + row * *h;
+    if(col == ncols - 1)
+        *w = m->ww - col * *w;
+    if(row == rows - 1)
+        *h = m->wh - row * *h;
+}
+
+/* handle the events that arrived, the first half of a batch */
+void dispatch(void) {
+    long long start, lag;
     XEvent ev;
 
+    /* XPending() flushes the output buffer and reads whatever arrived */
+    for(start = now_us(); running && XPending(display); ) {
+        XNextEvent(display, &ev);
+        stats.events++;
+        if(ev.type == KeyPress || ev.type == ButtonPress) {
+            lag = now_us() - start;
+            stats.inputs++;
+            stats.inputlag += lag;
+            stats.maxinputlag = MAX(stats.maxinputlag, lag);
+        }
+#ifdef COMPOSITOR
+        if(comp.active)
+            compevent(&ev);
+#endif
+        if(ev.type < LASTEvent && handler[ev.type]) {
+            XTRACE_EVENT(ev.type);
+            handler[ev.type](&ev); /* call handler */
+        }
+    }
+}
+
+/* what a batch of events leaves to do once the queue is empty */
+void finishbatch(void) {
+    commit();
+    /* only low priority work left, don't block until it is done */
+    if(workhead)
+        runwork();
+    if(bardirty)
+        drawbar();
+#ifdef COMPOSITOR
+    if(comp.active)
+        compbypass();
+    if(comp.ndam)
+        comppaint();
+#endif
+    if(shstate)
+        statepublish();
+    XFlush(display); /* what idle work, the bar and the compositor queued */
+}
+
+void handle_events(void) {
+    int i, n;
+    struct epoll_event ee[4];
+
     /* main event loop */
     XSync(display, False);
-    while(running && !XNextEvent(display, &ev))
-        if(handler[ev.type])
-            handler[ev.type](&ev); /* call handler */
+    while(running) {
+        dispatch();
+        if(!running)
+            break;
+        finishbatch();
+        /* idle work may have asked for more, round trips may have queued events */
+        if((n = epoll_wait(epfd, ee, LENGTH(ee), workhead || layoutdirty || focusdirty
+                           || stackdirty || QLength(display) ? 0 : -1)) < 0) {
+            if(errno == EINTR)
+                continue;
+            eprint("calavera-wm: epoll_wait: %s\n", strerror(errno));
+        }
+        stats.wakeups++;
+        for(i = 0; i < n; i++) {
+            if(ee[i].data.fd == sigfd)
+                handle_signals();
+            else if(ee[i].data.fd == inofd)
+                handle_inotify();
+            else if(ee[i].data.fd == tmrfd)
+                handle_timers();
+        }
+    }
+}
+
+void handle_inotify(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char *p;
+    ssize_t len;
+    struct inotify_event *ie;
+
+    while((len = read(inofd, buf, sizeof buf)) > 0)
+        for(p = buf; p < buf + len; p += sizeof *ie + ie->len) {
+            ie = (struct inotify_event *)p;
+            /* editors write, rename and delete in bursts, reload once it settles */
+            if(ie->len && !strcmp(ie->name, "config")) {
+                canceltimer(cfgtimer);
+                cfgtimer = settimer(RELOAD_DELAY, loadconfig, NULL);
+            }
+        }
+}
+
+void handle_signals(void) {
+    struct signalfd_siginfo si;
+
+    while(read(sigfd, &si, sizeof si) == sizeof si) {
+        switch(si.ssi_signo) {
+        case SIGCHLD:
+            reap();
+            break;
+        case SIGUSR1:
+            printstats();
+            break;
+        case SIGTERM:
+            running = False;
+            break;
+        }
+    }
+}
+
+void handle_timers(void) {
+    unsigned int i;
+    uint64_t expirations;
+    long long now;
+    void (*func)(void *);
+
+    if(read(tmrfd, &expirations, sizeof expirations) < 0 && errno != EAGAIN)
+        return;
+    now = now_ms();
+    for(i = 0; i < MAX_TIMERS; i++) {
+        if(!(func = timers[i].func) || timers[i].when > now)
+            continue;
+        /* free the slot first, the callback may re-arm itself */
+        timers[i].func = NULL;
+        stats.timers++;
+        func(timers[i].arg);
+    }
+    updatetimer();
+}
+
+void hoverexpire(void *arg) {
+    Client *c;
+
+    hovertimer = 0;
+    if(!(c = wintoclient(hoverwin)) || c == themon->thesel)
+        return;
+    focusx = hoverx;
+    focusy = hovery;
+    focus(c);
 }
 
 void keypress(XEvent *e) {
     unsigned int i;
     KeySym keysym;
     XKeyEvent *ev;
-    static int prefixset = 0;
 
     ev = &e->xkey;
     keysym = XkbKeycodeToKeysym(display, (KeyCode)e->xkey.keycode, 0, 0);
 
-    if(!prefixset && keysym == PREFIX_KEYSYM
-       && CLEANMASK(ev->state) == PREFIX_MODKEY) {
+    if(drag.type != DragNone && drag.keyboard) {
+        dragkey(keysym);
+        return;
+    }
+
+    if(!prefixset && keysym == cfg.prefixkey
+       && CLEANMASK(ev->state) == cfg.prefixmod) {
         prefixset = 1;
         grabkeys(CmdKey);
+        if(PREFIX_TIMEOUT)
+            prefixtimer = settimer(PREFIX_TIMEOUT, prefixexpire, NULL);
     }
     else {
-        for(i = 0; i < LENGTH(keys); i++)
-            if(keysym == keys[i].keysym
-               && CLEANMASK(ev->state) == keys[i].mod && keys[i].func)
-                keys[i].func(&(keys[i].arg));
+        canceltimer(prefixtimer);
+        prefixtimer = 0;
+        for(i = 0; i < cfg.nkeys; i++)
+            if(keysym == cfg.keys[i].keysym
+               && CLEANMASK(ev->state) == cfg.keys[i].mod && cfg.keys[i].func)
+                cfg.keys[i].func(&(cfg.keys[i].arg));
 
         prefixset = 0;
         grabkeys(PrefixKey);
@@ -777,12 +2937,66 @@ void killfocused(const Arg *arg) {
     killclient(themon->thesel);
 }
 
+void loadconfig(void *arg) {
+    Config new;
+
+    cfgtimer = 0;
+    defaultconfig(&new);
+    if(!parseconfig(cfgpath, &new)) {
+        freeconfig(&new);
+        return;
+    }
+    applyconfig(&new);
+}
+
+void loop_init(void) {
+    struct epoll_event ee = { .events = EPOLLIN };
+
+    /* signals are read synchronously from sigfd instead of handlers */
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGCHLD);
+    sigaddset(&sigmask, SIGUSR1);
+    sigaddset(&sigmask, SIGTERM);
+    if(sigprocmask(SIG_BLOCK, &sigmask, &origmask) < 0)
+        eprint("calavera-wm: sigprocmask: %s\n", strerror(errno));
+    if((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0
+       || (sigfd = signalfd(-1, &sigmask, SFD_NONBLOCK|SFD_CLOEXEC)) < 0
+       || (tmrfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0)
+        eprint("calavera-wm: cannot set up main loop: %s\n", strerror(errno));
+    ee.data.fd = ConnectionNumber(display);
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ee.data.fd, &ee);
+    ee.data.fd = sigfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ee.data.fd, &ee);
+    ee.data.fd = tmrfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ee.data.fd, &ee);
+    if(STATS_INTERVAL)
+        settimer(STATS_INTERVAL * 1000, statstimer, NULL);
+}
+
+/* take a dock in, it is mapped as is and only its struts matter */
+void managedock(Window w) {
+    Dock *d;
+
+    if(!(d = calloc(1, sizeof(Dock))))
+        eprint("fatal: could not malloc() %u bytes\n", sizeof(Dock));
+    d->win = w;
+    d->next = docks;
+    docks = d;
+    XSelectInput(display, w, PropertyChangeMask);
+    XMapWindow(display, w);
+    if(updatestrut(d))
+        updateworkarea();
+}
+
 /* manage the new client */
 void manage(Window w, XWindowAttributes *wa) {
     Client *c, *t = NULL;
+    Child *ch;
     Window trans = None;
-    XClassHint ch = { NULL, NULL };
+    Bool placed;
+    Rule r;
 
+    XTRACE_SCOPE("manage()");
     if(!(c = calloc(1, sizeof(Client))))
         eprint("fatal: could not malloc() %u bytes\n", sizeof(Client));
     c->win = w;
@@ -791,14 +3005,10 @@ void manage(Window w, XWindowAttributes *wa) {
         t = wintoclient(trans);
     if(t)
         themon = themon;
-    /* rule matching */
-    c->isfloating = 1;
-    XGetClassHint(display, c->win, &ch);
-
-    if(ch.res_class)
-        XFree(ch.res_class);
-    if(ch.res_name)
-        XFree(ch.res_name);
+    settransient(c, t);
+    raiseclient(themon, c); /* new windows are created on top */
+    /* the rules may decide otherwise below */
+    c->isfloating = !TILE_BY_DEFAULT;
 
     /* geometry */
     c->x = c->oldx = wa->x;
@@ -814,27 +3024,52 @@ void manage(Window w, XWindowAttributes *wa) {
     c->x = MAX(c->x, themon->mx);
     /* only fix client y-offset, if the client center might cover the bar */
     c->y = MAX(c->y, ((c->x + (c->w / 2) >= themon->wx)
-                      && (c->x + (c->w / 2) < themon->wx + themon->ww)) ? TOP_SIZE : themon->my);
-    c->bw = BORDER_SIZE;
+                      && (c->x + (c->w / 2) < themon->wx + themon->ww)) ? themon->wy : themon->my);
+    c->bw = cfg.bordersize;
 
     border_init(c);
     configure(c); /* propagates border_width, if size doesn't change */
-    updatesizehints(c);
+    /* hints are forced by the first resize(), the rest can wait for idle time */
+    queuework(c, WorkHints | WorkName | WorkClass | WorkState);
     XSelectInput(display, w, EVENT_MASK);
     grabbuttons(c, False);
-    if(!c->isfloating)
+    /* the launch it comes from, for the spawn to map latency */
+    if((ch = childfind(w)))
+        childmapped(ch);
+    if(!c->isfloating) {
+        flushwork(c, WorkHints);
         c->isfloating = c->oldstate = trans != None || c->isfixed;
-    if(c->isfloating)
-        XRaiseWindow(display, c->win);
-    attachend(c);
-    attachstackend(c);
-    focus(c);
+    }
+    if(scratchadopt(c, wa))
+        return;
+    r = rulematch(c, trans);
+    if(r.floating)
+        c->isfloating = c->oldstate = r.floating == RuleYes;
+    /* the last geometry of its class or a rule's, so the first paint is at the right size */
+    placed = REMEMBER_GEOMETRY && trans == None && geomapply(c);
+    if(r.w && c->isfloating) {
+        c->w = r.w;
+        c->h = r.h;
+        c->x = themon->mx + r.x;
+        c->y = themon->my + r.y;
+        clamptoarea(themon, WIDTH(c), HEIGHT(c), &c->x, &c->y);
+        placed = True;
+    }
+    /* windows asking for no particular position go where there is room */
+    if(c->isfloating && SMART_PLACEMENT && !placed && trans == None && !wa->x && !wa->y)
+        placeclient(c);
+    else if(c->isfloating && !freespace.dirty)
+        placeadd(c->x, c->y, WIDTH(c), HEIGHT(c));
+    attachend(themon, c);
+    attachstackend(themon, c);
+    tiledirty(c);
     XMoveResizeWindow(display, c->win, c->x + 2 * screen_w, c->y, c->w, c->h); /* some windows require this */
-    ewmh_setclientstate(c, NormalState);
-    themon->thesel = c;
     XMapWindow(display, c->win); /* maps the window */
+    XMoveWindow(display, c->win, c->x, c->y);
+    if(r.fullscreen == RuleYes)
+        setfullscreen(c, True);
     arrange_windows();
-    focus(NULL);
+    focus(r.focus != RuleNo ? c : NULL);
 }
 
 /* regrab when keyboard map changes */
@@ -850,116 +3085,634 @@ void mappingnotify(XEvent *e) {
 
 void maprequest(XEvent *e) {
     static XWindowAttributes wa;
+    Client *c;
     XMapRequestEvent *ev = &e->xmaprequest;
 
     if(!XGetWindowAttributes(display, ev->window, &wa))
         return;
     if(wa.override_redirect)
         return;
-    if(!wintoclient(ev->window))
+    if((c = wintoclient(ev->window))) {
+        if(c->ishidden) /* asks to be shown again */
+            scratchshow(c);
+    }
+    else if(isdock(ev->window))
+        managedock(ev->window);
+    else
         manage(ev->window, &wa);
 }
 
-void maximize(const Arg *arg) {
-    if(!themon->thesel || themon->thesel->isfullscreen || !(themon->thesel->isfloating))
-        return;
-    resize(themon->thesel, themon->wx, themon->wy, themon->ww - 2 * themon->thesel->bw,
-           themon->wh - 2 * themon->thesel->bw, False);
-    arrange_windows();
+void maximize(const Arg *arg) {
+    if(!themon->thesel || themon->thesel->isfullscreen || !(themon->thesel->isfloating))
+        return;
+    resize(themon->thesel, themon->wx, themon->wy, themon->ww - 2 * themon->thesel->bw,
+           themon->wh - 2 * themon->thesel->bw, False);
+    arrange_windows();
+}
+
+/* every tile covers the whole area, only the one on top is visible */
+void monocle(Monitor *m, int n, int i, int *x, int *y, int *w, int *h) {
+    *x = m->wx;
+    *y = m->wy;
+    *w = m->ww;
+    *h = m->wh;
+}
+
+void motionnotify(XEvent *e) {
+    XEvent ev;
+
+    if(drag.type == DragNone || drag.keyboard)
+        return;
+    /* only the latest position matters */
+    while(XCheckTypedEvent(display, MotionNotify, &ev))
+        e = &ev;
+    dragmotion(e->xmotion.x_root, e->xmotion.y_root);
+}
+
+void movekeyboard(const Arg *arg) {
+    dragstart(themon->thesel, DragMove, True);
+}
+
+void movemouse(const Arg *arg) {
+    dragstart(themon->thesel, DragMove, False);
+}
+
+void nextlayout(const Arg *arg) {
+    unsigned int i = themon->lt - layouts;
+
+    themon->lt = &layouts[(i + LENGTH(layouts) + arg->i) % LENGTH(layouts)];
+    themon->tilefrom = 0;
+    arrange_windows();
+}
+
+long long now_ms(void) {
+    return now_us() / 1000;
+}
+
+long long now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* area of the floating windows under x,y,w,h, counted up to just past limit */
+long overlap(int x, int y, int w, int h, long limit) {
+    long sum = 0;
+    int ox, oy;
+    Client *c;
+
+    for(c = themon->clients; c; c = c->next) {
+        if(!c->isfloating || c->isfullscreen)
+            continue;
+        ox = MIN(x + w, c->x + WIDTH(c)) - MAX(x, c->x);
+        oy = MIN(y + h, c->y + HEIGHT(c)) - MAX(y, c->y);
+        if(ox > 0 && oy > 0 && (sum += (long)ox * oy) > limit)
+            break;
+    }
+    return sum;
+}
+
+/* take x,y,w,h out of the free space */
+void placeadd(int x, int y, int w, int h) {
+    placecut(0, x, y, w, h, NULL);
+}
+
+/* the top left most free spot that fits c, else where it covers the least */
+void placeclient(Client *c) {
+    int i, w = WIDTH(c), h = HEIGHT(c), bx = themon->wx, by = themon->wy;
+    long best = -1;
+    long long start = now_us(), t;
+    Rect *f;
+    Client *o;
+
+    if(freespace.dirty)
+        placerebuild();
+    for(i = 0; i < freespace.n; i++) {
+        f = &freespace.r[i];
+        if(f->w >= w && f->h >= h && (best < 0 || f->y < by || (f->y == by && f->x < bx))) {
+            bx = f->x;
+            by = f->y;
+            best = 0;
+        }
+    }
+    /* no room: try the free corners and the spots right of and below each
+     * floating window, kept inside the area */
+    if(best < 0)
+        placetry(themon->wx, themon->wy, w, h, &bx, &by, &best);
+    for(i = 0; i < freespace.n && best; i++)
+        placetry(freespace.r[i].x, freespace.r[i].y, w, h, &bx, &by, &best);
+    for(o = themon->clients; o && best; o = o->next) {
+        if(!o->isfloating || o->isfullscreen)
+            continue;
+        placetry(o->x + WIDTH(o), o->y, w, h, &bx, &by, &best);
+        placetry(o->x, o->y + HEIGHT(o), w, h, &bx, &by, &best);
+    }
+    c->x = bx;
+    c->y = by;
+    placeadd(c->x, c->y, w, h);
+    stats.placements++;
+    t = now_us() - start;
+    stats.placetime += t;
+    stats.maxplacetime = MAX(stats.maxplacetime, t);
+}
+
+/* take x,y,w,h out of the free rectangles from index from on: every one it
+ * hits is replaced by the up to four maximal pieces left around it, those
+ * not touching keep (if not NULL) are dropped */
+void placecut(int from, int x, int y, int w, int h, const Rect *keep) {
+    int i, j, n = freespace.n;
+    Rect f, *a, *b;
+
+    for(i = from; i < n; i++) {
+        f = freespace.r[i];
+        if(!f.w || x >= f.x + f.w || y >= f.y + f.h || x + w <= f.x || y + h <= f.y)
+            continue;
+        freespace.r[i].w = 0;
+        if(x > f.x)
+            placepush(f.x, f.y, x - f.x, f.h);
+        if(x + w < f.x + f.w)
+            placepush(x + w, f.y, f.x + f.w - x - w, f.h);
+        if(y > f.y)
+            placepush(f.x, f.y, f.w, y - f.y);
+        if(y + h < f.y + f.h)
+            placepush(f.x, y + h, f.w, f.y + f.h - y - h);
+    }
+    /* only new pieces can lie inside another free rectangle, the old ones were maximal */
+    for(i = n; i < freespace.n; i++) {
+        a = &freespace.r[i];
+        if(keep && (a->x >= keep->x + keep->w || a->y >= keep->y + keep->h
+                    || a->x + a->w <= keep->x || a->y + a->h <= keep->y)) {
+            a->w = 0;
+            continue;
+        }
+        for(j = from; j < freespace.n; j++) {
+            b = &freespace.r[j];
+            if(j == i || !b->w || a->x < b->x || a->y < b->y
+               || a->x + a->w > b->x + b->w || a->y + a->h > b->y + b->h)
+                continue;
+            /* of two equal pieces the first one stays */
+            if(j < i || a->w != b->w || a->h != b->h) {
+                a->w = 0;
+                break;
+            }
+        }
+    }
+    for(i = j = from; i < freespace.n; i++)
+        if(freespace.r[i].w)
+            freespace.r[j++] = freespace.r[i];
+    freespace.n = j;
+}
+
+/* give r back to the free space where no floating window but skip covers
+ * it: the maximal rectangles through r are cut from the window area, keeping
+ * only pieces that touch r, and replace the old ones they contain, which
+ * are the only ones that could grow */
+void placefree(Client *skip, const Rect *r) {
+    int i, j, n = freespace.n;
+    Rect *a, *b;
+    Client *c;
+
+    if(r->x >= themon->wx + themon->ww || r->y >= themon->wy + themon->wh
+       || r->x + r->w <= themon->wx || r->y + r->h <= themon->wy)
+        return;
+    placepush(themon->wx, themon->wy, themon->ww, themon->wh);
+    for(c = themon->clients; c && freespace.n > n; c = c->next)
+        if(c != skip && c->isfloating && !c->isfullscreen)
+            placecut(n, c->x, c->y, WIDTH(c), HEIGHT(c), r);
+    for(i = 0; i < n; i++) {
+        a = &freespace.r[i];
+        for(j = n; j < freespace.n; j++) {
+            b = &freespace.r[j];
+            if(a->x >= b->x && a->y >= b->y
+               && a->x + a->w <= b->x + b->w && a->y + a->h <= b->y + b->h) {
+                a->w = 0;
+                break;
+            }
+        }
+    }
+    for(i = j = 0; i < freespace.n; i++)
+        if(freespace.r[i].w)
+            freespace.r[j++] = freespace.r[i];
+    freespace.n = j;
+}
+
+/* c, a floating window, was at the outer rectangle old */
+void placemove(Client *c, const Rect *old) {
+    if(freespace.dirty)
+        return;
+    placefree(c, old);
+    if(c->isfloating && !c->isfullscreen && !c->ishidden)
+        placeadd(c->x, c->y, WIDTH(c), HEIGHT(c));
+}
+
+/* keep x,y if it covers less of the other windows than the best spot so far */
+void placetry(int x, int y, int w, int h, int *bx, int *by, long *best) {
+    long o;
+
+    clamptoarea(themon, w, h, &x, &y);
+    o = overlap(x, y, w, h, *best < 0 ? LONG_MAX : *best);
+    if(*best < 0 || o < *best || (o == *best && (y < *by || (y == *by && x < *bx)))) {
+        *bx = x;
+        *by = y;
+        *best = o;
+    }
+}
+
+void placepush(int x, int y, int w, int h) {
+    if(freespace.n == freespace.max) {
+        freespace.max = freespace.max ? 2 * freespace.max : 64;
+        if(!(freespace.r = realloc(freespace.r, freespace.max * sizeof *freespace.r)))
+            eprint("fatal: could not realloc() %u bytes\n", freespace.max * sizeof *freespace.r);
+    }
+    freespace.r[freespace.n].x = x;
+    freespace.r[freespace.n].y = y;
+    freespace.r[freespace.n].w = w;
+    freespace.r[freespace.n].h = h;
+    freespace.n++;
+}
+
+/* the window area minus every floating window, after the area or borders changed */
+void placerebuild(void) {
+    Client *c;
+
+    freespace.n = 0;
+    placepush(themon->wx, themon->wy, themon->ww, themon->wh);
+    for(c = themon->clients; c; c = c->next)
+        if(c->isfloating && !c->isfullscreen)
+            placeadd(c->x, c->y, WIDTH(c), HEIGHT(c));
+    freespace.dirty = False;
+}
+
+/* leave command mode if no command key followed the prefix in time */
+void prefixexpire(void *arg) {
+    prefixtimer = 0;
+    if(!prefixset)
+        return;
+    prefixset = 0;
+    grabkeys(PrefixKey);
+}
+
+void printstats(void) {
+    static long long last;
+    static unsigned long lastfocus;
+    long long now = now_ms();
+    unsigned int i, j;
+    struct rusage ru;
+    Launch *l;
+
+    fprintf(stderr, "calavera-wm: events=%lu wakeups=%lu timers=%lu children=%lu\n",
+            stats.events, stats.wakeups, stats.timers, stats.children);
+    fprintf(stderr, "calavera-wm: focus=%lu (%.2f/s) applied=%lu restacks=%lu hovers=%lu\n", stats.focus,
+            last && now > last ? (stats.focus - lastfocus) * 1000.0 / (now - last) : 0.0,
+            stats.focusapplied, stats.restacks, stats.hovers);
+    fprintf(stderr, "calavera-wm: restacked windows=%lu (%.1f/restack)\n", stats.restacked,
+            stats.restacks ? (double)stats.restacked / stats.restacks : 0.0);
+    last = now;
+    lastfocus = stats.focus;
+    fprintf(stderr, "calavera-wm: configure requests=%lu issued=%lu\n",
+            stats.configreqs, stats.configures);
+    fprintf(stderr, "calavera-wm: layout %s tiles=%lu recomputed=%lu reconfigured=%lu\n",
+            themon->lt->symbol, (unsigned long)themon->ntiles, stats.tiles, stats.retiles);
+    fprintf(stderr, "calavera-wm: work idle=%lu forced=%lu inputlag avg=%lldus max=%lldus\n",
+            stats.workidle, stats.workforced,
+            stats.inputs ? stats.inputlag / (long long)stats.inputs : 0, stats.maxinputlag);
+#ifdef COMPOSITOR
+    if(comp.active)
+        fprintf(stderr, "calavera-wm: frames=%lu culled=%lu area avg=%lldpx time avg=%lldus max=%lldus\n",
+                stats.frames, stats.culled,
+                stats.frames ? stats.framearea / (long long)stats.frames : 0,
+                stats.frames ? stats.frametime / (long long)stats.frames : 0, stats.maxframetime);
+    if(comp.active)
+        fprintf(stderr, "calavera-wm: fullscreen bypasses=%lu time=%lldms%s\n", stats.bypasses,
+                stats.bypasstime + (comp.bypass ? now - comp.bypassstart : 0),
+                comp.bypass ? " (bypassing)" : "");
+#endif
+    if(SWITCHER_OVERLAY)
+        fprintf(stderr, "calavera-wm: switcher draws=%lu thumbnails rendered=%lu\n",
+                stats.switchers, stats.thumbs);
+    fprintf(stderr, "calavera-wm: rules=%u matched=%lu avg=%lldus glob states built=%lu\n",
+            cfg.nrules, stats.rulematches,
+            stats.rulematches ? stats.ruletime / (long long)stats.rulematches : 0, stats.globstates);
+    fprintf(stderr, "calavera-wm: placements=%lu free rectangles=%d avg=%lldus max=%lldus\n",
+            stats.placements, freespace.n,
+            stats.placements ? stats.placetime / (long long)stats.placements : 0, stats.maxplacetime);
+    if(barwin)
+        fprintf(stderr, "calavera-wm: bar draws=%lu segments=%lu avg=%lldus max=%lldus\n",
+                stats.bardraws, stats.barsegs,
+                stats.bardraws ? stats.bartime / (long long)stats.bardraws : 0, stats.maxbartime);
+    for(i = 0; i < MAX_LAUNCHES && launches[i].cmd[0]; i++) {
+        l = &launches[i];
+        fprintf(stderr, "calavera-wm: launch %s spawns=%lu mapped=%lu timeouts=%lu dups=%lu"
+                " failures=%lu avg=%lldms max=%lldms\n", l->cmd, l->spawns, l->maps, l->timeouts,
+                l->dups, l->failures, l->maps ? l->total / (long long)l->maps : 0, l->max);
+        fprintf(stderr, "calavera-wm:   spawn to map");
+        for(j = 0; j < LAUNCH_BUCKETS - 1; j++)
+            fprintf(stderr, " <%dms=%lu", 16 << j, l->hist[j]);
+        fprintf(stderr, " >=%dms=%lu\n", 16 << (LAUNCH_BUCKETS - 2), l->hist[j]);
+    }
+    if(!getrusage(RUSAGE_SELF, &ru))
+        fprintf(stderr, "calavera-wm: cpu user=%ldms sys=%ldms\n",
+                ru.ru_utime.tv_sec * 1000L + ru.ru_utime.tv_usec / 1000,
+                ru.ru_stime.tv_sec * 1000L + ru.ru_stime.tv_usec / 1000);
+    XTRACE_REPORT();
+}
+
+/* action and argument of a bind or button line, commands are copied into cfg */
+Bool parsebinding(Config *cfg, char **tok, int ntok, Arg *arg, void (**func)(const Arg *)) {
+    unsigned int i;
+    int j, argc;
+    char **argv, *end;
+
+    for(i = 0; i < LENGTH(actions) && strcmp(actions[i].name, tok[0]); i++);
+    if(i == LENGTH(actions))
+        return False;
+    *func = actions[i].func;
+    arg->i = 0;
+    switch(actions[i].argtype) {
+    case ArgNone:
+        return ntok == 1;
+    case ArgInt:
+        if(ntok != 2)
+            return False;
+        arg->i = strtol(tok[1], &end, 10);
+        return *end == '\0';
+    case ArgFloat:
+        if(ntok != 2)
+            return False;
+        arg->f = strtof(tok[1], &end);
+        return *end == '\0';
+    case ArgCmd:
+        if(ntok < 2)
+            return False;
+        argc = ntok - 1;
+        argv = cfgalloc(cfg, (argc + 1) * sizeof *argv);
+        tok++;
+        break;
+    case ArgRaise: /* class, then at most 3 words, runorraise() finds the class at [4] */
+        if(ntok < 3 || ntok > 5)
+            return False;
+        argc = ntok - 2;
+        argv = cfgalloc(cfg, 5 * sizeof *argv);
+        argv[4] = strcpy(cfgalloc(cfg, strlen(tok[1]) + 1), tok[1]);
+        tok += 2;
+        break;
+    default:
+        return False;
+    }
+    for(j = 0; j < argc; j++)
+        argv[j] = strcpy(cfgalloc(cfg, strlen(tok[j]) + 1), tok[j]);
+    arg->v = argv;
+    return True;
+}
+
+/* parse path into cfg on top of what is in it, False if missing or invalid */
+Bool parseconfig(const char *path, Config *cfg) {
+    FILE *f;
+    char line[1024], *tok[32], *end;
+    const char *name;
+    int ntok, lineno = 0;
+    long n;
+    unsigned int mod, nkeys = 0, nbuttons = 0, nrules = 0;
+    Bool ok = True, valid;
+    Key *k = NULL;
+    Button *b = NULL;
+    Rule *r = NULL;
+    void (*func)(const Arg *);
+    Arg arg;
+    KeySym keysym;
+
+    if(!(f = fopen(path, "r")))
+        return False;
+    while(fgets(line, sizeof line, f)) {
+        lineno++;
+        if(!(ntok = splitline(line, tok, LENGTH(tok))) || tok[0][0] == '#')
+            continue;
+        valid = ntok == 2;
+        if(!strcmp(tok[0], "bind") || !strcmp(tok[0], "button")) {
+            valid = ntok >= 3 && parsemods(tok[1], &mod, &name)
+                    && parsebinding(cfg, tok + 2, ntok - 2, &arg, &func);
+            if(valid && !strcmp(tok[0], "bind")) {
+                if((valid = (keysym = XStringToKeysym(name)) != NoSymbol)) {
+                    if(!(k = realloc(k, (nkeys + 1) * sizeof *k)))
+                        eprint("fatal: could not malloc() %u bytes\n", (nkeys + 1) * sizeof *k);
+                    k[nkeys].mod = mod;
+                    k[nkeys].keysym = keysym;
+                    k[nkeys].func = func;
+                    k[nkeys++].arg = arg;
+                }
+            }
+            else if(valid) {
+                if((valid = name[0] >= '1' && name[0] <= '5' && !name[1])) {
+                    if(!(b = realloc(b, (nbuttons + 1) * sizeof *b)))
+                        eprint("fatal: could not malloc() %u bytes\n", (nbuttons + 1) * sizeof *b);
+                    b[nbuttons].mask = mod;
+                    b[nbuttons].button = Button1 + name[0] - '1';
+                    b[nbuttons].func = func;
+                    b[nbuttons++].arg = arg;
+                }
+            }
+        }
+        else if(!strcmp(tok[0], "rule")) {
+            if(!(r = realloc(r, (nrules + 1) * sizeof *r)))
+                eprint("fatal: could not malloc() %u bytes\n", (nrules + 1) * sizeof *r);
+            if((valid = ntok >= 2 && parserule(cfg, tok + 1, ntok - 1, &r[nrules])))
+                nrules++;
+        }
+        else if(valid && !strcmp(tok[0], "prefix"))
+            valid = parsemods(tok[1], &cfg->prefixmod, &name)
+                    && (cfg->prefixkey = XStringToKeysym(name)) != NoSymbol;
+        else if(valid && (!strcmp(tok[0], "focus_color") || !strcmp(tok[0], "unfocus_color"))) {
+            n = strtol(tok[1] + (tok[1][0] == '#'), &end, 16);
+            if((valid = *end == '\0' && n >= 0))
+                *(tok[0][0] == 'f' ? &cfg->focuscolor : &cfg->unfocuscolor) = n;
+        }
+        else if(valid) {
+            n = strtol(tok[1], &end, 10);
+            valid = *end == '\0' && n >= 0;
+            if(!strcmp(tok[0], "border_size"))
+                cfg->bordersize = n;
+            else if(!strcmp(tok[0], "snap"))
+                cfg->snap = n;
+            else if(!strcmp(tok[0], "top_size"))
+                cfg->topsize = n;
+            else if(!strcmp(tok[0], "bottom_size"))
+                cfg->bottomsize = n;
+            else
+                valid = False;
+        }
+        if(!valid) {
+            fprintf(stderr, "calavera-wm: %s:%d: invalid line\n", path, lineno);
+            ok = False;
+        }
+    }
+    fclose(f);
+    /* bindings in the file replace the compiled in tables as a whole */
+    if(k) {
+        cfg->mem = realloc(cfg->mem, (cfg->nmem + 1) * sizeof *cfg->mem);
+        cfg->mem[cfg->nmem++] = cfg->keys = k;
+        cfg->nkeys = nkeys;
+    }
+    if(b) {
+        cfg->mem = realloc(cfg->mem, (cfg->nmem + 1) * sizeof *cfg->mem);
+        cfg->mem[cfg->nmem++] = cfg->buttons = b;
+        cfg->nbuttons = nbuttons;
+    }
+    if(r) {
+        cfg->mem = realloc(cfg->mem, (cfg->nmem + 1) * sizeof *cfg->mem);
+        cfg->mem[cfg->nmem++] = r;
+        cfg->rules = r;
+        cfg->nrules = nrules;
+    }
+    return ok;
+}
+
+/* C-, S-, M- and W- prefixes for Control, Shift, Mod1 and Mod4 */
+Bool parsemods(const char *spec, unsigned int *mod, const char **rest) {
+    *mod = 0;
+    for(; spec[0] && spec[1] == '-' && spec[2]; spec += 2) {
+        switch(spec[0]) {
+        case 'C': *mod |= ControlMask; break;
+        case 'S': *mod |= ShiftMask; break;
+        case 'M': *mod |= Mod1Mask; break;
+        case 'W': *mod |= Mod4Mask; break;
+        default: return False;
+        }
+    }
+    *rest = spec;
+    return True;
 }
 
-void movemouse(const Arg *arg) {
-    int x, y, ocx, ocy, nx, ny;
-    Client *c;
-    XEvent ev;
-
-    if(!(c = themon->thesel))
-        return;
-    if(c->isfullscreen) /* no support moving fullscreen windows by mouse */
-        return;
-    restack();
-    ocx = c->x;
-    ocy = c->y;
-    /* Warp pointer to center on move */
-    XWarpPointer(display, None, c->win, 0, 0, 0, 0, c->w / 2, c->h / 2);
-    if(XGrabPointer(display, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
-                    None, cursor[CurMove], CurrentTime) != GrabSuccess)
-        return;
-    if(!getrootptr(&x, &y))
-        return;
-    do {
-        XMaskEvent(display, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
-        switch(ev.type) {
-        case ConfigureRequest:
-        case Expose:
-        case MapRequest:
-            handler[ev.type](&ev);
-            break;
-        case MotionNotify:
-            nx = ocx + (ev.xmotion.x - x);
-            ny = ocy + (ev.xmotion.y - y);
-            if(nx >= themon->wx && nx <= themon->wx + themon->ww
-               && ny >= themon->wy && ny <= themon->wy + themon->wh) {
-                if(abs(themon->wx - nx) < SNAP)
-                    nx = themon->wx;
-                else if(abs((themon->wx + themon->ww) - (nx + WIDTH(c))) < SNAP)
-                    nx = themon->wx + themon->ww - WIDTH(c);
-                if(abs(themon->wy - ny) < SNAP)
-                    ny = themon->wy;
-                else if(abs((themon->wy + themon->wh) - (ny + HEIGHT(c))) < SNAP)
-                    ny = themon->wy + themon->wh - HEIGHT(c);
-                if(!c->isfloating && (abs(nx - c->x) > SNAP || abs(ny - c->y) > SNAP));
-            }
-            if(c->isfloating)
-                resize(c, nx, ny, c->w, c->h, True);
-            break;
+/* patterns as class=, instance=, title=, role= and type=, settings as float,
+ * tile, fullscreen, focus, nofocus and geometry=WxH+X+Y */
+Bool parserule(Config *cfg, char **tok, int ntok, Rule *r) {
+    static const char *keys[RuleLast] = { "class=", "instance=", "title=", "role=", "type=" };
+    int i, j;
+    size_t len;
+    char *pat;
+
+    memset(r, 0, sizeof *r);
+    for(i = 0; i < ntok; i++) {
+        for(j = 0; j < RuleLast && strncmp(tok[i], keys[j], strlen(keys[j])); j++);
+        if(j < RuleLast) {
+            len = strlen(tok[i] + strlen(keys[j])) + 1;
+            pat = cfgalloc(cfg, len);
+            memcpy(pat, tok[i] + strlen(keys[j]), len);
+            *(const char **)((char *)r + rulepatterns[j]) = pat;
         }
-    } while(ev.type != ButtonRelease);
-    XUngrabPointer(display, CurrentTime);
+        else if(!strcmp(tok[i], "float") || !strcmp(tok[i], "tile"))
+            r->floating = tok[i][0] == 'f' ? RuleYes : RuleNo;
+        else if(!strcmp(tok[i], "fullscreen"))
+            r->fullscreen = RuleYes;
+        else if(!strcmp(tok[i], "focus") || !strcmp(tok[i], "nofocus"))
+            r->focus = tok[i][0] == 'f' ? RuleYes : RuleNo;
+        else if(strncmp(tok[i], "geometry=", 9)
+                || sscanf(tok[i] + 9, "%dx%d+%d+%d", &r->w, &r->h, &r->x, &r->y) != 4
+                || r->w <= 0 || r->h <= 0)
+            return False;
+    }
+    return True;
 }
 
 void propertynotify(XEvent *e) {
     Client *c;
+    Dock *d;
     Window trans;
     XPropertyEvent *ev = &e->xproperty;
 
     if(ev->state == PropertyDelete)
         return; /* ignore */
+    else if(ev->window == root && ev->atom == XA_WM_NAME && barwin) {
+        if(!gettextprop(root, XA_WM_NAME, stext, sizeof stext))
+            snprintf(stext, sizeof stext, "calavera-wm-%s", VERSION);
+        bardirty = True;
+    }
     else if((c = wintoclient(ev->window))) {
         switch(ev->atom) {
         default: break;
         case XA_WM_TRANSIENT_FOR:
-            if(!c->isfloating && (XGetTransientForHint(display, c->win, &trans)) &&
-               (c->isfloating = (wintoclient(trans)) != NULL))
+            if(!XGetTransientForHint(display, c->win, &trans))
+                trans = None;
+            if(settransient(c, wintoclient(trans)))
+                restack();
+            if(!c->isfloating && (c->isfloating = c->transfor != NULL))
                 arrange_windows();
             break;
         case XA_WM_NORMAL_HINTS:
-            updatesizehints(c);
+            queuework(c, WorkHints);
+            break;
+        case XA_WM_CLASS:
+            queuework(c, WorkClass);
             break;
         }
+        if(ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName])
+            queuework(c, WorkName);
+    }
+    else if((d = wintodock(ev->window))
+            && (ev->atom == netatom[NetWMStrutPartial] || ev->atom == netatom[NetWMStrut])
+            && updatestrut(d))
+        updateworkarea();
+}
+
+void queuework(Client *c, unsigned int work) {
+    if(!c->work) {
+        if(worktail)
+            worktail->wnext = c;
+        else
+            workhead = c;
+        worktail = c;
     }
+    c->work |= work;
 }
 
 void quit(const Arg *arg) {
     running = False;
 }
 
+void reap(void) {
+    int status;
+    pid_t pid;
+    Child **pc, *c;
+
+    while(0 < (pid = waitpid(-1, &status, WNOHANG))) {
+        stats.children++;
+        for(pc = &children; *pc && (*pc)->pid != pid; pc = &(*pc)->next);
+        if(!(c = *pc)) /* inherited, e.g. from the autostart script */
+            continue;
+        *pc = c->next;
+        childexit(c, status);
+        free(c);
+    }
+}
+
 void reload(const Arg *arg) {
     running = False;
     if (arg) {
-        cleanup();
+        /* hand the clients over as they are instead of unmanaging them */
+        dragstop(False);
+        /* the geometry table isn't written until geomtimer fires */
+        if(geomtimer) {
+            canceltimer(geomtimer);
+            geomsave(NULL);
+        }
+        savestate();
+        XCloseDisplay(display);
+        /* the new instance and what it spawns start with the signals unblocked */
+        sigprocmask(SIG_SETMASK, &origmask, NULL);
         execvp(cargv[0], cargv);
         eprint("Can't exec: %s\n", strerror(errno));
     }
 }
 
 void resize(Client *c, int x, int y, int w, int h, Bool interact) {
-    if(applysizehints(c, &x, &y, &w, &h, interact))
+    flushwork(c, WorkHints);
+    if(applysizehints(themon, c, &x, &y, &w, &h, cfg.topsize, interact))
         resizeclient(c, x, y, w, h);
 }
 
 void resizeclient(Client *c, int x, int y, int w, int h) {
     XWindowChanges wc;
+    Rect old = { c->x, c->y, WIDTH(c), HEIGHT(c) };
 
     c->oldx = c->x; c->x = wc.x = x;
     c->oldy = c->y; c->y = wc.y = y;
@@ -968,80 +3721,353 @@ void resizeclient(Client *c, int x, int y, int w, int h) {
     wc.border_width = c->bw;
     XConfigureWindow(display, c->win, RESIZE_MASK, &wc);
     configure(c);
-    sync_display();
+    if(c->isfloating) /* tiled windows are no obstacles */
+        placemove(c, &old);
+}
+
+void resizekeyboard(const Arg *arg) {
+    dragstart(themon->thesel, DragResize, True);
 }
 
 void resizemouse(const Arg *arg) {
-    int ocx, ocy;
-    int nw, nh;
-    Client *c;
-    XEvent ev;
+    dragstart(themon->thesel, DragResize, False);
+}
 
-    if(!(c = themon->thesel))
-        return;
-    if(c->isfullscreen) /* no support resizing fullscreen windows by mouse */
-        return;
-    restack();
-    ocx = c->x;
-    ocy = c->y;
-    if(XGrabPointer(display, root, False, MOUSEMASK, GrabModeAsync, GrabModeAsync,
-                    None, cursor[CurResize], CurrentTime) != GrabSuccess)
-        return;
-    /* When resizing warp pointer to left-right corner */
-    XWarpPointer(display, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
-    do {
-        XMaskEvent(display, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
-        switch(ev.type) {
-        case ConfigureRequest:
-        case Expose:
-        case MapRequest:
-            handler[ev.type](&ev);
-            break;
-        case MotionNotify:
-            nw = MAX(ev.xmotion.x - ocx - 2 * c->bw + 1, 1);
-            nh = MAX(ev.xmotion.y - ocy - 2 * c->bw + 1, 1);
-            if(themon->wx + nw >= themon->wx && themon->wx + nw <= themon->wx + themon->ww
-               && themon->wy + nh >= themon->wy && themon->wy + nh <= themon->wy + themon->wh)
-                {
-                    if(!c->isfloating && (abs(nw - c->w) > SNAP || abs(nh - c->h) > SNAP));
+/* raise the selected client once the batch is done, see commit() */
+void restack() {
+    stackdirty = True;
+}
+
+/* sort cfg.rules by pattern into rulefields, once per config */
+void rulecompile(void) {
+    unsigned int i, h, len;
+    const char *pat, *p;
+    RuleField *f;
+    Exact *e;
+
+    rulefree();
+    rulewords = MAX(1, (cfg.nrules + BITWORD - 1) / BITWORD);
+    for(f = rulefields; f < rulefields + RuleLast; f++) {
+        if(!(f->any = calloc(rulewords, sizeof *f->any)))
+            eprint("fatal: could not malloc() %u bytes\n", rulewords * sizeof *f->any);
+        f->start = -1;
+    }
+    for(i = 0; i < cfg.nrules; i++)
+        for(f = rulefields; f < rulefields + RuleLast; f++) {
+            pat = *(const char **)((const char *)&cfg.rules[i] + rulepatterns[f - rulefields]);
+            if(!pat || !strcmp(pat, "*")) {
+                SETBIT(f->any, i);
+                continue;
+            }
+            f->used = True;
+            if(!strpbrk(pat, "*?")) {
+                for(h = 0, p = pat; *p; p++)
+                    h = h * 31 + (unsigned char)*p;
+                h %= LENGTH(f->exact);
+                for(e = f->exact[h]; e && strcmp(e->s, pat); e = e->next);
+                if(!e) {
+                    if(!(e = calloc(1, sizeof(Exact))) || !(e->rules = calloc(rulewords, sizeof *e->rules)))
+                        eprint("fatal: could not malloc() %u bytes\n", sizeof(Exact));
+                    e->s = pat;
+                    e->next = f->exact[h];
+                    f->exact[h] = e;
                 }
-            if(c->isfloating)
-                resize(c, c->x, c->y, nw, nh, True);
-            break;
+                SETBIT(e->rules, i);
+                continue;
+            }
+            len = strlen(pat) + 1;
+            if(f->nglobs + len > (unsigned int)f->maxglobs) {
+                f->maxglobs = MAX(2 * f->maxglobs, f->nglobs + len + 64);
+                if(!(f->globs = realloc(f->globs, f->maxglobs))
+                   || !(f->globrule = realloc(f->globrule, f->maxglobs * sizeof *f->globrule))
+                   || !(f->starts = realloc(f->starts, f->maxglobs * sizeof *f->starts)))
+                    eprint("fatal: could not realloc() %u bytes\n", f->maxglobs * sizeof(int));
+            }
+            memcpy(f->globs + f->nglobs, pat, len);
+            f->starts[f->nstarts++] = f->nglobs;
+            while(len--)
+                f->globrule[f->nglobs++] = i;
         }
-    } while(ev.type != ButtonRelease);
-    XWarpPointer(display, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
-    XUngrabPointer(display, CurrentTime);
-    while(XCheckMaskEvent(display, EnterWindowMask, &ev));
+    for(f = rulefields; f < rulefields + RuleLast; f++) {
+        if(!f->nglobs)
+            continue;
+        if(!(f->tmp = malloc(f->nglobs * sizeof *f->tmp)) || !(f->mark = calloc(f->nglobs, 1))
+           || !(f->states = malloc(MAX_GLOBSTATES * sizeof *f->states)))
+            eprint("fatal: could not malloc() %u bytes\n", MAX_GLOBSTATES * sizeof *f->states);
+    }
 }
 
-/* restores all clients */
-void restack() {
-    XEvent ev;
+void rulefree(void) {
+    int i;
+    RuleField *f;
+    Exact *e;
+
+    for(f = rulefields; f < rulefields + RuleLast; f++) {
+        for(i = 0; i < (int)LENGTH(f->exact); i++)
+            while((e = f->exact[i])) {
+                f->exact[i] = e->next;
+                free(e->rules);
+                free(e);
+            }
+        for(i = 0; i < f->nstates; i++) {
+            free(f->states[i].pos);
+            free(f->states[i].match);
+        }
+        free(f->any);
+        free(f->globs);
+        free(f->globrule);
+        free(f->starts);
+        free(f->states);
+        free(f->tmp);
+        free(f->mark);
+        memset(f, 0, sizeof *f);
+    }
+}
 
-    if(!themon->thesel)
-        return;
-    XRaiseWindow(display, themon->thesel->win);
-    sync_display();
-    while(XCheckMaskEvent(display, EnterWindowMask, &ev));
+/* the settings of all rules matching c merged, later rules win; each
+ * property costs a hash lookup and a DFA walk however many rules there are */
+Rule rulematch(Client *c, Window trans) {
+    char title[BUFSIZE], role[BUFSIZE];
+    const char *value[RuleLast];
+    unsigned long m[rulewords], all[rulewords], *g;
+    unsigned int h;
+    int w;
+    long long start = now_us();
+    const char *p;
+    RuleField *f;
+    Exact *e;
+    const Rule *r;
+    Rule res = { 0 };
+
+    if(!cfg.nrules)
+        return res;
+    value[RuleClass] = c->class;
+    value[RuleInstance] = c->instance;
+    value[RuleTitle] = value[RuleRole] = value[RuleType] = "";
+    if(rulefields[RuleTitle].used) {
+        flushwork(c, WorkName);
+        snprintf(title, sizeof title, "%s", c->name);
+        value[RuleTitle] = title;
+    }
+    if(rulefields[RuleRole].used && gettextprop(c->win, wmatom[WMRole], role, sizeof role))
+        value[RuleRole] = role;
+    if(rulefields[RuleType].used)
+        value[RuleType] = windowtype(c, trans);
+    memset(all, 0xff, sizeof all);
+    if(cfg.nrules % BITWORD) /* rules without any pattern match everything */
+        all[rulewords - 1] = (1UL << cfg.nrules % BITWORD) - 1;
+    for(f = rulefields; f < rulefields + RuleLast; f++) {
+        if(!f->used)
+            continue;
+        memcpy(m, f->any, sizeof m);
+        for(h = 0, p = value[f - rulefields]; *p; p++)
+            h = h * 31 + (unsigned char)*p;
+        h %= LENGTH(f->exact);
+        for(e = f->exact[h]; e && strcmp(e->s, value[f - rulefields]); e = e->next);
+        for(w = 0; e && w < rulewords; w++)
+            m[w] |= e->rules[w];
+        if(f->nglobs)
+            for(g = globmatch(f, value[f - rulefields]), w = 0; w < rulewords; w++)
+                m[w] |= g[w];
+        for(w = 0; w < rulewords; w++)
+            all[w] &= m[w];
+    }
+    /* only the matching rules are visited */
+    for(w = 0; w < rulewords; w++)
+        for(; all[w]; all[w] &= all[w] - 1) {
+            r = &cfg.rules[w * BITWORD + __builtin_ctzl(all[w])];
+            if(r->floating)
+                res.floating = r->floating;
+            if(r->fullscreen)
+                res.fullscreen = r->fullscreen;
+            if(r->focus)
+                res.focus = r->focus;
+            if(r->w) {
+                res.x = r->x;
+                res.y = r->y;
+                res.w = r->w;
+                res.h = r->h;
+            }
+        }
+    stats.rulematches++;
+    stats.ruletime += now_us() - start;
+    return res;
 }
 
 void runorraise(const Arg *arg) {
     char *app = ((char **)arg->v)[4];
     Client *c;
-    XClassHint hint = { NULL, NULL };
 
+    XTRACE_SCOPE("runorraise()");
     /* Tries to find the client */
     for (c = themon->clients; c; c = c->next) {
-        XGetClassHint(display, c->win, &hint);
-        if (hint.res_class && strcmp(app, hint.res_class) == 0) {
+        flushwork(c, WorkClass);
+        if (strcmp(app, c->class) == 0) {
             focus(c);
-            XRaiseWindow(display, c->win);
+            restack();
             return;
         }
     }
-    /* Client not found: spawn it */
-    spawn(arg);
+    /* Client not found: spawn it, unless the last launch is still starting */
+    spawnchild((char **)arg->v, app);
+}
+
+/* run queued work while no events are pending, for at most IDLE_BUDGET us */
+void runwork(void) {
+    long long end = now_us() + IDLE_BUDGET;
+    unsigned int work;
+    Client *c;
+
+    while((c = workhead) && !XPending(display)) {
+        work = c->work;
+        dequeuework(c);
+        stats.workidle++;
+        dowork(c, work);
+        if(now_us() >= end)
+            break;
+    }
+}
+
+/* adopt the clients a previous instance saved on reload(), checking them
+ * against the window tree instead of querying each one */
+unsigned int restorestate(Window *wins, unsigned int num) {
+    int format;
+    unsigned long i, n, extra;
+    unsigned int restored = 0;
+    long *p = NULL, *r;
+    long long saved;
+    Atom real;
+    Window *tree;
+    Client *c, **list, **raise;
+
+    if(XGetWindowProperty(display, root, wmatom[WMSnapshot], 0L, LONG_MAX / 4, True,
+                          XA_CARDINAL, &real, &format, &n, &extra,
+                          (unsigned char **)&p) != Success || !p)
+        return 0;
+    if(format != 32 || n < 5 || (unsigned long)p[0] != SNAPSHOT_MAGIC
+       || (unsigned long)p[1] * SnapLast != n - 5) {
+        XFree(p);
+        return 0;
+    }
+    saved = (long long)(unsigned int)p[2] << 32 | (unsigned int)p[3];
+    n = p[1];
+    if(!(tree = malloc((num + 1) * sizeof *tree)) || !(list = calloc(n + 1, sizeof *list))
+       || !(raise = calloc(n + 1, sizeof *raise)))
+        eprint("fatal: could not malloc() %u bytes\n", n * sizeof *list);
+    memcpy(tree, wins, num * sizeof *tree);
+    qsort(tree, num, sizeof *tree, wincmp);
+    /* records are in focus order */
+    for(i = 0; i < n; i++) {
+        r = p + 5 + i * SnapLast;
+        if(!bsearch(&r[SnapWin], tree, num, sizeof *tree, wincmp)
+           || (unsigned long)r[SnapListPos] >= n || list[r[SnapListPos]]
+           || (unsigned long)r[SnapRaisePos] >= n || raise[r[SnapRaisePos]])
+            continue;
+        if(!(c = calloc(1, sizeof(Client))))
+            eprint("fatal: could not malloc() %u bytes\n", sizeof(Client));
+        c->win = r[SnapWin];
+        c->x = (int)r[SnapX];
+        c->y = (int)r[SnapY];
+        c->w = (int)r[SnapW];
+        c->h = (int)r[SnapH];
+        c->oldx = (int)r[SnapOldX];
+        c->oldy = (int)r[SnapOldY];
+        c->oldw = (int)r[SnapOldW];
+        c->oldh = (int)r[SnapOldH];
+        c->bw = (int)r[SnapBW];
+        c->oldbw = (int)r[SnapOldBW];
+        c->isfloating = (r[SnapFlags] & SnapFloating) != 0;
+        c->isfullscreen = (r[SnapFlags] & SnapFullscreen) != 0;
+        c->oldstate = (r[SnapFlags] & SnapOldState) != 0;
+        c->neverfocus = (r[SnapFlags] & SnapNeverFocus) != 0;
+        c->isabove = (r[SnapFlags] & SnapAbove) != 0;
+        c->isbelow = (r[SnapFlags] & SnapBelow) != 0;
+        /* selections and grabs died with the old connection */
+        XSelectInput(display, c->win, EVENT_MASK);
+        grabbuttons(c, False);
+        XSetWindowBorder(display, c->win, cfg.unfocuscolor);
+        queuework(c, WorkHints | WorkName | WorkClass);
+        attachstackend(themon, c);
+        list[r[SnapListPos]] = c;
+        raise[r[SnapRaisePos]] = c;
+        restored++;
+    }
+    for(i = n; i-- > 0; )
+        if(list[i])
+            attach(themon, list[i]);
+    /* bottom up, and the transients after, raiseclient() would regroup them */
+    for(i = n; i-- > 0; )
+        if(raise[i])
+            raiseclient(themon, raise[i]);
+    for(i = 0; i < n; i++) {
+        r = p + 5 + i * SnapLast;
+        if((unsigned long)r[SnapListPos] < n && (c = list[r[SnapListPos]]) && c->win == (Window)r[SnapWin])
+            settransient(c, wintoclient(r[SnapTransFor]));
+    }
+    themon->tilefrom = 0;
+    if(restored) {
+        focus(wintoclient(p[4]));
+        fprintf(stderr, "calavera-wm: restored %u clients in %lldus after reload\n",
+                restored, now_us() - saved);
+    }
+    free(raise);
+    free(list);
+    free(tree);
+    XFree(p);
+    return restored;
+}
+
+/* save the clients, their focus, raise and client list order, and the state that
+ * can't be read back from the windows to the root window for the next instance */
+void savestate(void) {
+    unsigned long n = 0, i;
+    long *p, *r;
+    long long now = now_us();
+    Client *c, *l;
+
+    /* scratchpads are adopted again by manage() */
+    for(c = themon->thestack; c; c = c->snext)
+        if(!c->scratch)
+            n++;
+    if(!(p = calloc(5 + n * SnapLast, sizeof *p)))
+        return;
+    p[0] = SNAPSHOT_MAGIC;
+    p[1] = n;
+    p[2] = (now >> 32) & 0xffffffff;
+    p[3] = now & 0xffffffff;
+    p[4] = themon->thesel && !themon->thesel->scratch ? themon->thesel->win : None;
+    for(c = themon->thestack, r = p + 5; c; c = c->snext) {
+        if(c->scratch)
+            continue;
+        for(i = 0, l = themon->clients; l && l != c; l = l->next)
+            if(!l->scratch)
+                i++;
+        r[SnapWin] = c->win;
+        r[SnapX] = c->x;
+        r[SnapY] = c->y;
+        r[SnapW] = c->w;
+        r[SnapH] = c->h;
+        r[SnapOldX] = c->oldx;
+        r[SnapOldY] = c->oldy;
+        r[SnapOldW] = c->oldw;
+        r[SnapOldH] = c->oldh;
+        r[SnapBW] = c->bw;
+        r[SnapOldBW] = c->oldbw;
+        r[SnapFlags] = (c->isfloating ? SnapFloating : 0) | (c->isfullscreen ? SnapFullscreen : 0)
+                       | (c->oldstate ? SnapOldState : 0) | (c->neverfocus ? SnapNeverFocus : 0)
+                       | (c->isabove ? SnapAbove : 0) | (c->isbelow ? SnapBelow : 0);
+        r[SnapListPos] = i;
+        for(i = 0, l = themon->raised; l && l != c; l = l->rnext)
+            if(!l->scratch)
+                i++;
+        r[SnapRaisePos] = i;
+        r[SnapTransFor] = c->transfor && !c->transfor->scratch ? c->transfor->win : None;
+        r += SnapLast;
+    }
+    XChangeProperty(display, root, wmatom[WMSnapshot], XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *)p, 5 + n * SnapLast);
+    sync_display();
+    free(p);
 }
 
 void scan(void) {
@@ -1049,16 +4075,24 @@ void scan(void) {
     Window d1, d2, *wins = NULL;
     XWindowAttributes wa;
 
+    XTRACE_SCOPE("scan()");
     if(XQueryTree(display, root, &d1, &d2, &wins, &num)) {
+        /* after reload() most windows are known already */
+        if(restorestate(wins, num))
+            for(i = 0; i < num; i++)
+                if(wintoclient(wins[i]))
+                    wins[i] = None;
         for(i = 0; i < num; i++) {
-            if(!XGetWindowAttributes(display, wins[i], &wa)
+            if(wins[i] == None || !XGetWindowAttributes(display, wins[i], &wa)
                || wa.override_redirect || XGetTransientForHint(display, wins[i], &d1))
                 continue;
-            if(wa.map_state == IsViewable || ewmh_getstate(wins[i]) == IconicState)
+            if(wa.map_state == IsViewable && isdock(wins[i]))
+                managedock(wins[i]);
+            else if(wa.map_state == IsViewable || ewmh_getstate(wins[i]) == IconicState)
                 manage(wins[i], &wa);
         }
         for(i = 0; i < num; i++) { /* now the transients */
-            if(!XGetWindowAttributes(display, wins[i], &wa))
+            if(wins[i] == None || !XGetWindowAttributes(display, wins[i], &wa))
                 continue;
             if(XGetTransientForHint(display, wins[i], &d1)
                && (wa.map_state == IsViewable || ewmh_getstate(wins[i]) == IconicState))
@@ -1069,6 +4103,76 @@ void scan(void) {
     }
 }
 
+/* take c into its scratchpad slot, hidden, unless it is shown already */
+Bool scratchadopt(Client *c, XWindowAttributes *wa) {
+    unsigned int i;
+
+    flushwork(c, WorkClass);
+    for(i = 0; i < LENGTH(scratchpads); i++)
+        if(!scratch[i].c && !strcmp(c->instance, scratchpads[i].instance))
+            break;
+    if(i == LENGTH(scratchpads))
+        return False;
+    scratch[i].c = c;
+    scratch[i].spawned = False;
+    c->scratch = i + 1;
+    c->isfloating = True;
+    c->x = themon->wx + (themon->ww - WIDTH(c)) / 2;
+    c->y = themon->wy + (themon->wh - HEIGHT(c)) / 2;
+    XMoveWindow(display, c->win, c->x, c->y);
+    if(wa->map_state == IsViewable) {
+        c->ignoreunmap++;
+        XUnmapWindow(display, c->win);
+    }
+    c->ishidden = True;
+    dropwork(c, WorkState);
+    ewmh_setclientstate(c, IconicState);
+    if(scratch[i].show)
+        scratchshow(c);
+    return True;
+}
+
+void scratchhide(Client *c) {
+    if(drag.c == c)
+        dragstop(False);
+    c->ignoreunmap++;
+    XUnmapWindow(display, c->win);
+    ewmh_setclientstate(c, IconicState);
+    detach(themon, c);
+    detachstack(themon, c);
+    c->ishidden = True;
+    placemove(c, &(Rect){ c->x, c->y, WIDTH(c), HEIGHT(c) });
+    if(themon->thesel == c) {
+        themon->thesel = NULL;
+        focus(NULL);
+        restack();
+    }
+}
+
+void scratchshow(Client *c) {
+    scratch[c->scratch - 1].show = False;
+    c->ishidden = False;
+    attach(themon, c);
+    attachstack(themon, c);
+    placemove(c, &(Rect){ c->x, c->y, WIDTH(c), HEIGHT(c) });
+    ewmh_setclientstate(c, NormalState);
+    XMapRaised(display, c->win);
+    raiseclient(themon, c);
+    focus(c);
+    restack();
+}
+
+/* launch the scratchpads scan() didn't find running */
+void scratchstart(void) {
+    unsigned int i;
+
+    for(i = 0; i < LENGTH(scratchpads); i++)
+        if(!scratch[i].c && !scratch[i].spawned) {
+            scratch[i].spawned = True;
+            spawn(&(Arg){ .v = scratchpads[i].cmd });
+        }
+}
+
 void ewmh_setclientstate(Client *c, long state) {
     long data[] = { state, None };
 
@@ -1076,6 +4180,27 @@ void ewmh_setclientstate(Client *c, long state) {
                     PropModeReplace, (unsigned char *)data, 2);
 }
 
+/* _NET_WM_STATE from the states of c the WM supports */
+void ewmh_setwmstate(Client *c) {
+    Atom state[3];
+    int n = 0;
+
+    if(c->isfullscreen)
+        state[n++] = netatom[NetWMFullscreen];
+    if(c->isabove)
+        state[n++] = netatom[NetWMAbove];
+    if(c->isbelow)
+        state[n++] = netatom[NetWMBelow];
+    XChangeProperty(display, c->win, netatom[NetWMState], XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)state, n);
+}
+
+/* a state after a _NET_WM_STATE request for it */
+Bool ewmh_statechange(long action, Bool set) {
+    return action == 1 /* _NET_WM_STATE_ADD */
+           || (action == 2 /* _NET_WM_STATE_TOGGLE */ && !set);
+}
+
 static Bool sendevent(Client *c, Atom proto){
     int n;
     Atom *protocols;
@@ -1100,6 +4225,18 @@ static Bool sendevent(Client *c, Atom proto){
     return exists;
 }
 
+void setfloating(Client *c, Bool floating) {
+    if(c->isfullscreen || c->isfloating == floating)
+        return;
+    tiledirty(c);
+    c->isfloating = floating;
+    tiledirty(c);
+    placemove(c, &(Rect){ c->x, c->y, WIDTH(c), HEIGHT(c) });
+    if(c->isfloating)
+        raiseclient(themon, c);
+    arrange_windows();
+}
+
 void setfocus(Client *c) {
     if(!c->neverfocus) {
         XSetInputFocus(display, c->win, RevertToPointerRoot, CurrentTime);
@@ -1108,21 +4245,25 @@ void setfocus(Client *c) {
 }
 
 void setfullscreen(Client *c, Bool fullscreen) {
+    XTRACE_SCOPE("setfullscreen()");
+    /* the border changes too, placemove() couldn't tell what it covered */
+    freespace.dirty = True;
     if(fullscreen) {
-        XChangeProperty(display, c->win, netatom[NetWMState], XA_ATOM, 32,
-                        PropModeReplace, (unsigned char*)&netatom[NetWMFullscreen], 1);
+        tiledirty(c);
         c->isfullscreen = True;
+        ewmh_setwmstate(c);
         c->oldstate = c->isfloating;
         c->oldbw = c->bw;
         c->bw = 0;
         c->isfloating = True;
         resizeclient(c, themon->mx, themon->my, themon->mw, themon->mh);
-        XRaiseWindow(display, c->win);
+        raiseclient(themon, c);
+        restack();
+        arrangetiles(themon);
     }
     else {
-        XChangeProperty(display, c->win, netatom[NetWMState], XA_ATOM, 32,
-                        PropModeReplace, (unsigned char*)0, 0);
         c->isfullscreen = False;
+        ewmh_setwmstate(c);
         c->isfloating = c->oldstate;
         c->bw = c->oldbw;
         c->x = c->oldx;
@@ -1130,29 +4271,80 @@ void setfullscreen(Client *c, Bool fullscreen) {
         c->w = c->oldw;
         c->h = c->oldh;
         resizeclient(c, c->x, c->y, c->w, c->h);
+        tiledirty(c);
         arrange_windows();
     }
 }
 
+/* arg > 1.0 sets mfact absolutely */
+void setmfact(const Arg *arg) {
+    float f = arg->f < 1.0 ? arg->f + themon->mfact : arg->f - 1.0;
+
+    if(f < 0.05 || f > 0.95)
+        return;
+    themon->mfact = f;
+    themon->tilefrom = 0;
+    arrange_windows();
+}
+
+int settimer(int ms, void (*func)(void *), void *arg) {
+    unsigned int i;
+
+    for(i = 0; i < MAX_TIMERS && timers[i].func; i++);
+    if(i == MAX_TIMERS) {
+        fprintf(stderr, "calavera-wm: out of timers\n");
+        return 0;
+    }
+    timers[i].when = now_ms() + ms;
+    timers[i].func = func;
+    timers[i].arg = arg;
+    updatetimer();
+    return i + 1;
+}
+
 void setup(void) {
     XSetWindowAttributes wa;
 
-    /* clean up any zombies immediately */
-    sigchld(0);
+    /* route signals through the main loop and clean up any zombies immediately */
+    loop_init();
+    reap();
+
+    /* settings, the config file overrides conf.h */
+    defaultconfig(&cfg);
+    watchconfig();
+    if(cfgpath[0] && !parseconfig(cfgpath, &cfg)) {
+        freeconfig(&cfg);
+        defaultconfig(&cfg);
+    }
+    rulecompile();
+
+    if(REMEMBER_GEOMETRY)
+        geomload();
+    if(SHARED_STATE)
+        stateinit();
 
     /* init screen */
     screen = DefaultScreen(display);
     root = RootWindow(display, screen);
     screen_w = DisplayWidth(display, screen);
     screen_h = DisplayHeight(display, screen);
-    updategeom();
 
     /* Standard & EWMH atoms */
     ewmh_init();
+    updategeom();
 
     /* cursors */
     init_cursors();
 
+    /* bar, the work area makes room for it */
+    if(SHOW_BAR) {
+        initbar();
+        updateworkarea();
+    }
+#ifdef COMPOSITOR
+    compinit();
+#endif
+
     /* select for events */
     wa.cursor = cursor[CurNormal];
     wa.event_mask = WA_EVENT_MASK;
@@ -1166,35 +4358,274 @@ void setup(void) {
 void showhide(Client *c) {
     if(!c)
         return;
-    XMoveWindow(display, c->win, c->x, c->y);
-
     if(c->isfloating && !c->isfullscreen)
         resize(c, c->x, c->y, c->w, c->h, False);
     showhide(c->snext);
 }
 
-void sigchld(int unused) {
-    if(signal(SIGCHLD, sigchld) == SIG_ERR)
-        eprint("Can't install SIGCHLD handler");
-    while(0 < waitpid(-1, NULL, WNOHANG));
+/* split line into whitespace separated words, double quotes group words */
+int splitline(char *line, char **tok, int max) {
+    int n = 0;
+
+    while(n < max) {
+        while(*line == ' ' || *line == '\t' || *line == '\n')
+            line++;
+        if(!*line)
+            break;
+        if(*line == '"') {
+            tok[n++] = ++line;
+            while(*line && *line != '"')
+                line++;
+        }
+        else {
+            tok[n++] = line;
+            while(*line && *line != ' ' && *line != '\t' && *line != '\n')
+                line++;
+        }
+        if(*line)
+            *line++ = '\0';
+    }
+    return n;
 }
 
 void spawn(const Arg *arg) {
-    if(fork() == 0) {
+    spawnchild((char **)arg->v, NULL);
+}
+
+/* fork and exec argv and keep track of the child, app is the class of the
+ * window runorraise() expects, a second launch of it waits for the first */
+void spawnchild(char **argv, const char *app) {
+    static unsigned long seq = 0;
+    char id[64];
+    pid_t pid;
+    Child *c;
+
+    if(app && (c = childpending(app))) {
+        if(c->launch)
+            c->launch->dups++;
+        return;
+    }
+    /* startup notification aware toolkits copy it to _NET_STARTUP_ID */
+    snprintf(id, sizeof id, "calavera-wm-%d-%lu", (int)getpid(), ++seq);
+    if((pid = fork()) == 0) {
         if(display)
             close(ConnectionNumber(display));
+        sigprocmask(SIG_SETMASK, &origmask, NULL);
         setsid();
-        execvp(((char **)arg->v)[0], (char **)arg->v);
-        fprintf(stderr, "calavera-wm: execvp %s", ((char **)arg->v)[0]);
+        setenv("DESKTOP_STARTUP_ID", id, 1);
+        execvp(argv[0], argv);
+        fprintf(stderr, "calavera-wm: execvp %s", argv[0]);
         perror(" failed");
-        exit(EXIT_SUCCESS);
+        exit(127);
+    }
+    if(pid < 0) {
+        perror("calavera-wm: fork");
+        return;
     }
+    if(!(c = calloc(1, sizeof(Child))))
+        eprint("fatal: could not malloc() %u bytes\n", sizeof(Child));
+    c->pid = pid;
+    c->start = now_ms();
+    c->pending = True;
+    snprintf(c->id, sizeof c->id, "%s", id);
+    snprintf(c->app, sizeof c->app, "%s", app ? app : "");
+    if((c->launch = childlaunch(argv[0])))
+        c->launch->spawns++;
+    c->next = children;
+    children = c;
+}
+
+/* tells readers still mapping the snapshot that the WM is gone */
+void stateclose(void) {
+    char name[64];
+
+    if(!shstate)
+        return;
+    __atomic_store_n(&shstate->seq, shstate->seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shstate->magic = 0;
+    __atomic_store_n(&shstate->seq, shstate->seq + 1, __ATOMIC_RELEASE);
+    munmap(shstate, sizeof *shstate);
+    shstate = NULL;
+    calavera_state_name(name, sizeof name, DisplayString(display), getuid());
+    shm_unlink(name);
+}
+
+/* maps the snapshot, after a restart the one readers already have mapped */
+void stateinit(void) {
+    char name[64];
+    int fd;
+    void *p;
+
+    calavera_state_name(name, sizeof name, DisplayString(display), getuid());
+    if((fd = shm_open(name, O_RDWR|O_CREAT, 0600)) < 0) {
+        fprintf(stderr, "calavera-wm: shm_open %s: %s\n", name, strerror(errno));
+        return;
+    }
+    if(ftruncate(fd, sizeof *shstate) < 0
+       || (p = mmap(NULL, sizeof *shstate, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        fprintf(stderr, "calavera-wm: cannot map %s: %s\n", name, strerror(errno));
+    else
+        shstate = p;
+    close(fd);
+    if(!shstate)
+        return;
+    /* an instance that died while writing left seq odd */
+    __atomic_store_n(&shstate->seq, shstate->seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shstate->magic = CALAVERA_STATE_MAGIC;
+    shstate->version = CALAVERA_STATE_VERSION;
+    shstate->pid = getpid();
+    shstate->generation++;
+    __atomic_store_n(&shstate->seq, shstate->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* rewrites what changed in the snapshot, once per event batch */
+void statepublish(void) {
+    char layout[sizeof shstate->layout] = { 0 };
+    unsigned int n;
+    Bool changed = False;
+    Client *c;
+    CalaveraState *s = shstate;
+    CalaveraStateClient r;
+
+#define STATESET(F, V) do { if(s->F != (V)) { s->F = (V); changed = True; } } while(0)
+    /* readers retry while seq is odd */
+    __atomic_store_n(&s->seq, s->seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for(n = 0, c = themon->clients; c; c = c->next, n++) {
+        if(n >= CALAVERA_STATE_MAXCLIENTS)
+            continue;
+        memset(&r, 0, sizeof r);
+        r.win = c->win;
+        r.x = c->x;
+        r.y = c->y;
+        r.w = c->w;
+        r.h = c->h;
+        r.bw = c->bw;
+        r.flags = (c->isfloating ? CalaveraStateFloating : 0)
+                  | (c->isfullscreen ? CalaveraStateFullscreen : 0)
+                  | (c->ishidden ? CalaveraStateHidden : 0)
+                  | (c->scratch ? CalaveraStateScratch : 0)
+                  | (c->isfixed ? CalaveraStateFixed : 0);
+        strncpy(r.name, c->name, sizeof r.name - 1);
+        strncpy(r.class, c->class, sizeof r.class - 1);
+        strncpy(r.instance, c->instance, sizeof r.instance - 1);
+        if(memcmp(&r, &s->clients[n], sizeof r)) {
+            s->clients[n] = r;
+            changed = True;
+        }
+    }
+    STATESET(total, n);
+    STATESET(nclients, MIN(n, CALAVERA_STATE_MAXCLIENTS));
+    /* commit() applied it earlier in the batch, hidden clients aren't in it */
+    for(n = 0; n < CALAVERA_STATE_MAXCLIENTS && n < (unsigned int)stacking.nclients; n++)
+        STATESET(stack[n], stacking.order[stacking.nclients - 1 - n]->win);
+    for(; n < CALAVERA_STATE_MAXCLIENTS; n++)
+        STATESET(stack[n], 0);
+    STATESET(focus, themon->thesel ? themon->thesel->win : 0);
+    STATESET(numbase, VIEW_NUMBER_MAP);
+    STATESET(sw, screen_w);
+    STATESET(sh, screen_h);
+    STATESET(wx, themon->wx);
+    STATESET(wy, themon->wy);
+    STATESET(ww, themon->ww);
+    STATESET(wh, themon->wh);
+    strncpy(layout, themon->lt->symbol, sizeof layout - 1);
+    if(memcmp(layout, s->layout, sizeof layout)) {
+        memcpy(s->layout, layout, sizeof layout);
+        changed = True;
+    }
+#undef STATESET
+    if(changed)
+        s->generation++;
+    s->time = now_ms();
+    s->counters.events = stats.events;
+    s->counters.wakeups = stats.wakeups;
+    s->counters.timers = stats.timers;
+    s->counters.children = stats.children;
+    s->counters.focus = stats.focus;
+    s->counters.configreqs = stats.configreqs;
+    s->counters.configures = stats.configures;
+    s->counters.tiles = stats.tiles;
+    s->counters.retiles = stats.retiles;
+    s->counters.bardraws = stats.bardraws;
+    s->counters.frames = stats.frames;
+    s->counters.placements = stats.placements;
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+void statstimer(void *arg) {
+    printstats();
+    settimer(STATS_INTERVAL * 1000, statstimer, NULL);
 }
 
 void sync_display(void) {
     XSync(display, False);
 }
 
+/* master/stack: nmaster tiles share the left mfact of the area, the rest the right */
+void tile(Monitor *m, int n, int i, int *x, int *y, int *w, int *h) {
+    int nm = MIN(n, m->nmaster), mw;
+
+    mw = n > nm ? (nm ? m->ww * m->mfact : 0) : m->ww;
+    if(i < nm) {
+        *x = m->wx;
+        *w = mw;
+        *h = m->wh / nm;
+        *y = m->wy + i * *h;
+        if(i == nm - 1)
+            *h = m->wh - i * *h;
+    }
+    else {
+        i -= nm;
+        *x = m->wx + mw;
+        *w = m->ww - mw;
+        *h = m->wh / (n - nm);
+        *y = m->wy + i * *h;
+        if(i == n - nm - 1)
+            *h = m->wh - i * *h;
+    }
+}
+
+/* the tiles from c's on need recomputing, called while c is tiled */
+void tiledirty(Client *c) {
+    int i;
+    Client *t;
+
+    if(!ISTILED(c))
+        return;
+    for(i = 0, t = themon->clients; t && t != c; t = t->next)
+        if(ISTILED(t))
+            i++;
+    themon->tilefrom = MIN(themon->tilefrom, i);
+}
+
+void togglefloating(const Arg *arg) {
+    if(themon->thesel)
+        setfloating(themon->thesel, !themon->thesel->isfloating);
+}
+
+/* show or hide a scratchpad, starting it again if it went away */
+void togglescratch(const Arg *arg) {
+    Scratch *s;
+
+    if(arg->i < 0 || arg->i >= (int)LENGTH(scratchpads))
+        return;
+    s = &scratch[arg->i];
+    if(!s->c) {
+        s->show = True;
+        if(!s->spawned) {
+            s->spawned = True;
+            spawn(&(Arg){ .v = scratchpads[arg->i].cmd });
+        }
+    }
+    else if(s->c->ishidden)
+        scratchshow(s->c);
+    else
+        scratchhide(s->c);
+}
+
 void fullscreen(const Arg *arg) {
     if(!themon->thesel)
         return;
@@ -1207,7 +4638,7 @@ void unfocus(Client *c, Bool setfocus) {
         return;
     grabbuttons(c, False);
     /* set new border unfocus colour. */
-    XSetWindowBorder(display, c->win, UNFOCUS);
+    XSetWindowBorder(display, c->win, cfg.unfocuscolor);
     if(setfocus) {
         XSetInputFocus(display, root, RevertToPointerRoot, CurrentTime);
     }
@@ -1215,11 +4646,31 @@ void unfocus(Client *c, Bool setfocus) {
 
 /* destroy the client */
 void unmanage(Client *c, Bool destroyed) {
+    Client *t;
     XWindowChanges wc;
 
+    XTRACE_SCOPE("unmanage()");
     /* The server grab construct avoids race conditions. */
-    detach(c);
-    detachstack(c);
+    if(drag.c == c) {
+        drag.c = NULL;
+        dragstop(False);
+    }
+    tiledirty(c);
+    geomremember(c);
+    if(c->scratch) {
+        scratch[c->scratch - 1].c = NULL;
+        scratch[c->scratch - 1].spawned = False;
+    }
+    if(!c->ishidden) {
+        detach(themon, c);
+        detachstack(themon, c);
+        if(c->isfloating && !c->isfullscreen && !freespace.dirty)
+            placefree(c, &(Rect){ c->x, c->y, WIDTH(c), HEIGHT(c) });
+    }
+    detachraise(themon, c);
+    for(t = themon->raised; t; t = t->rnext)
+        if(t->transfor == c)
+            t->transfor = NULL;
     if(!destroyed) {
         wc.border_width = c->oldbw;
         XGrabServer(display);
@@ -1231,27 +4682,64 @@ void unmanage(Client *c, Bool destroyed) {
         XSetErrorHandler(xerror);
         XUngrabServer(display);
     }
+    dequeuework(c);
+    if(themon->thesel == c)
+        themon->thesel = NULL;
+    if(xfocus == c)
+        xfocus = NULL;
     free(c);
     focus(NULL);
     arrange_windows();
 }
 
 
+void unmanagedock(Dock *d) {
+    Dock **p;
+    Bool reserved = d->strut[0] || d->strut[1] || d->strut[2] || d->strut[3];
+
+    for(p = &docks; *p != d; p = &(*p)->next);
+    *p = d->next;
+    free(d);
+    if(reserved)
+        updateworkarea();
+}
+
 void unmapnotify(XEvent *e) {
     Client *c;
+    Dock *d;
     XUnmapEvent *ev = &e->xunmap;
 
     if((c = wintoclient(ev->window))) {
-        if(ev->send_event)
+        if(ev->send_event) {
+            dropwork(c, WorkState); /* don't republish NormalState later */
             ewmh_setclientstate(c, WithdrawnState);
+        }
+        else if(c->ignoreunmap)
+            c->ignoreunmap--;
         else
             unmanage(c, False);
     }
+    else if((d = wintodock(ev->window)))
+        unmanagedock(d);
 }
 
-void set_padding() {
-    themon->wy += TOP_SIZE;
-    themon->wh -= TOP_SIZE + BOTTOM_SIZE;
+/* work area is the screen minus the larger of TOP_SIZE/BOTTOM_SIZE, the bar and the docks' struts */
+Bool set_padding() {
+    long s[4] = { 0, 0, MAX(cfg.topsize, barh), cfg.bottomsize };
+    int i, x = themon->wx, y = themon->wy, w = themon->ww, h = themon->wh;
+    Dock *d;
+
+    for(d = docks; d; d = d->next)
+        for(i = 0; i < 4; i++)
+            s[i] = MAX(s[i], d->strut[i]);
+    themon->wx = themon->mx + s[0];
+    themon->ww = themon->mw - s[0] - s[1];
+    themon->wy = themon->my + s[2];
+    themon->wh = themon->mh - s[2] - s[3];
+    if(themon->wx == x && themon->wy == y && themon->ww == w && themon->wh == h)
+        return False;
+    themon->tilefrom = 0;
+    return True;
 }
 
 Bool updategeom(void) {
@@ -1261,13 +4749,30 @@ Bool updategeom(void) {
         themon = createmon();
     if(themon->mw != screen_w || themon->mh != screen_h) {
         dirty = True;
-        themon->mw = themon->ww = screen_w;
-        themon->mh = themon->wh = screen_h;
-        set_padding();
+        themon->mw = screen_w;
+        themon->mh = screen_h;
+        updatebarpos();
+        updateworkarea();
     }
     return dirty;
 }
 
+/* arm tmrfd for the earliest pending deadline, disarm it if there is none */
+void updatetimer(void) {
+    unsigned int i;
+    long long when = 0;
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+
+    for(i = 0; i < MAX_TIMERS; i++)
+        if(timers[i].func && (!when || timers[i].when < when))
+            when = timers[i].when;
+    if(when) {
+        its.it_value.tv_sec = when / 1000;
+        its.it_value.tv_nsec = (when % 1000) * 1000000;
+    }
+    timerfd_settime(tmrfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
 void updatenumlockmask(void) {
     unsigned int i, j;
     XModifierKeymap *modmap;
@@ -1282,6 +4787,22 @@ void updatenumlockmask(void) {
     XFreeModifiermap(modmap);
 }
 
+void updateclass(Client *c) {
+    XClassHint ch = { NULL, NULL };
+
+    c->class[0] = c->instance[0] = '\0';
+    if(!XGetClassHint(display, c->win, &ch))
+        return;
+    if(ch.res_class) {
+        strncpy(c->class, ch.res_class, sizeof c->class - 1);
+        XFree(ch.res_class);
+    }
+    if(ch.res_name) {
+        strncpy(c->instance, ch.res_name, sizeof c->instance - 1);
+        XFree(ch.res_name);
+    }
+}
+
 void updatesizehints(Client *c) {
     long msize;
     XSizeHints size;
@@ -1331,19 +4852,131 @@ void updatesizehints(Client *c) {
                   && c->maxw == c->minw && c->maxh == c->minh);
 }
 
+/* after a screen size change, the pixmap is redrawn as a whole */
+void updatebarpos(void) {
+    int i;
+
+    if(!barwin)
+        return;
+    if(barpix)
+        XFreePixmap(display, barpix);
+    barpix = XCreatePixmap(display, root, themon->mw, barh, DefaultDepth(display, screen));
+    XMoveResizeWindow(display, barwin, themon->mx, themon->my, themon->mw, barh);
+    for(i = 0; i < SegLast; i++)
+        segs[i].w = -1;
+    bardirty = True;
+}
+
+/* reread the space d reserves, _NET_WM_STRUT_PARTIAL wins over _NET_WM_STRUT */
+Bool updatestrut(Dock *d) {
+    int i;
+    long strut[4] = { 0, 0, 0, 0 };
+    Bool changed = False;
+
+    if(!getstrut(d->win, netatom[NetWMStrutPartial], strut))
+        getstrut(d->win, netatom[NetWMStrut], strut);
+    for(i = 0; i < 4; i++) {
+        changed |= d->strut[i] != strut[i];
+        d->strut[i] = strut[i];
+    }
+    return changed;
+}
+
+/* recompute the work area, only clients in the strips it lost are moved */
+void updateworkarea(void) {
+    int ox = themon->wx, oy = themon->wy, ow = themon->ww, oh = themon->wh, x, y;
+    long data[4];
+    Client *c;
+
+    if(!set_padding())
+        return;
+    freespace.dirty = True;
+    data[0] = themon->wx;
+    data[1] = themon->wy;
+    data[2] = themon->ww;
+    data[3] = themon->wh;
+    XChangeProperty(display, root, netatom[NetWorkarea], XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *)data, 4);
+    for(c = themon->clients; c; c = c->next) {
+        if(!c->isfloating || c->isfullscreen || !inlostarea(c, ox, oy, ow, oh))
+            continue;
+        x = c->x;
+        y = c->y;
+        clamptoarea(themon, WIDTH(c), HEIGHT(c), &x, &y);
+        resize(c, x, y, c->w, c->h, False);
+    }
+    arrangetiles(themon);
+}
+
+void updatetitle(Client *c) {
+    if(!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name))
+        gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
+    if(c == themon->thesel)
+        bardirty = True;
+}
+
+/* _NET_WM_WINDOW_TYPE without the prefix in lower case, atom names are cached */
+const char *windowtype(Client *c, Window trans) {
+    static struct {
+        Atom atom;
+        char name[32];
+    } types[16];
+    static unsigned int ntypes;
+    unsigned int i;
+    char *name, *p;
+    Atom atom;
+
+    if(!(atom = getatomprop(c, netatom[NetWMWindowType])))
+        return trans != None ? "dialog" : "normal";
+    for(i = 0; i < ntypes && types[i].atom != atom; i++);
+    if(i == ntypes) {
+        if(!(name = XGetAtomName(display, atom)))
+            return "";
+        i = ntypes < LENGTH(types) ? ntypes++ : LENGTH(types) - 1;
+        types[i].atom = atom;
+        p = strncmp(name, "_NET_WM_WINDOW_TYPE_", 20) ? name : name + 20;
+        snprintf(types[i].name, sizeof types[i].name, "%s", p);
+        for(p = types[i].name; *p; p++)
+            *p = tolower((unsigned char)*p);
+        XFree(name);
+    }
+    return types[i].name;
+}
+
+int wincmp(const void *a, const void *b) {
+    Window wa = *(const Window *)a, wb = *(const Window *)b;
+
+    return wa < wb ? -1 : wa > wb;
+}
+
 Client *wintoclient(Window w) {
     Client *c;
+    unsigned int i;
 
     for(c = themon->clients; c; c = c->next)
         if(c->win == w)
             return c;
+    for(i = 0; i < LENGTH(scratch); i++)
+        if(scratch[i].c && scratch[i].c->win == w)
+            return scratch[i].c;
     return NULL;
 }
 
 /* There's no way to check accesses to destroyed windows, thus those cases are
  * ignored (especially on UnmapNotify's).  Other types of errors call Xlibs
  * default error handler, which may call exit.  */
+Dock *wintodock(Window w) {
+    Dock *d;
+
+    for(d = docks; d && d->win != w; d = d->next);
+    return d;
+}
+
 int xerror(Display *display, XErrorEvent *ee) {
+#ifdef COMPOSITOR
+    if(comperror(ee))
+        return 0;
+#endif
     if(ee->error_code == BadWindow
        || (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch)
        || (ee->request_code == X_PolySegment && ee->error_code == BadDrawable)
@@ -1367,12 +5000,33 @@ int xerrorstart(Display *display, XErrorEvent *ee) {
     return -1;
 }
 
+/* reload the config file when it changes, the directory is watched
+ * because editors tend to replace the file instead of writing to it */
+void watchconfig(void) {
+    char dir[PATH_MAX - 16];
+    char *home;
+    struct epoll_event ee = { .events = EPOLLIN };
+
+    if(!(home = getenv("HOME")))
+        return;
+    snprintf(dir, sizeof(dir), "%s/calavera-wm", home);
+    snprintf(cfgpath, sizeof(cfgpath), "%s/config", dir);
+    if((inofd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) < 0)
+        return;
+    if(inotify_add_watch(inofd, dir, IN_CLOSE_WRITE|IN_MOVED_TO|IN_CREATE|IN_DELETE) < 0) {
+        close(inofd);
+        inofd = -1;
+        return;
+    }
+    ee.data.fd = inofd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, inofd, &ee);
+}
+
 void view(const Arg *arg) {
-    int i;
     Client *c;
 
-    for(c = themon->clients, i = VIEW_NUMBER_MAP; c && i < arg->ui; c = c->next, i++);
-    if(c)
+    XTRACE_SCOPE("view()");
+    if((c = nthclient(themon, VIEW_NUMBER_MAP, arg->ui)))
         themon->thesel = c;
     focus(c);
     restack();
@@ -1440,6 +5094,7 @@ int main(int argc, char *argv[]) {
     checkotherwm();
     setup();
     scan();
+    scratchstart();
     autorun();
     handle_events();
     cleanup();
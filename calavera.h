@@ -0,0 +1,117 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Core of calavera-wm (libcalavera.a, see libcalavera.c): the client and
+ * monitor types and the logic on them that makes no X calls, that is size
+ * hints, the client and focus lists, picking the client the switcher and
+ * view go to, the snapping and clamping of floating windows and the
+ * stacking order. The WM links against it, bench/micro benchmarks it on
+ * its own.
+ */
+
+#ifndef CALAVERA_H
+#define CALAVERA_H
+
+#include <X11/Xlib.h>
+
+#define BUFSIZE 256
+
+#define MAX(A, B)               ((A) > (B) ? (A) : (B))
+#define MIN(A, B)               ((A) < (B) ? (A) : (B))
+#define ISTILED(C)              (!(C)->isfloating && !(C)->isfullscreen)
+#define WIDTH(X)                ((X)->w + 2 * (X)->bw)
+#define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
+
+/* stacking layers, the bottom one first */
+enum { LayerBelow, LayerNormal, LayerAbove, LayerFullscreen, LayerLast };
+
+typedef struct Monitor Monitor;
+typedef struct Client Client;
+typedef struct Geometry Geometry;
+struct Client {
+    char name[BUFSIZE];
+    char class[BUFSIZE], instance[BUFSIZE];
+    float mina, maxa;
+    int x, y, w, h;  /* current position and size */
+    int oldx, oldy, oldw, oldh;
+    int basew, baseh, incw, inch, maxw, maxh, minw, minh;
+    int bw, oldbw;
+    Bool isfixed, isfloating, neverfocus, oldstate, isfullscreen, ishidden;
+    Bool isabove, isbelow; /* _NET_WM_STATE_ABOVE and _NET_WM_STATE_BELOW */
+    int layer;         /* Layer* at the last stackorder() */
+    unsigned int work; /* pending Work* bits */
+    int scratch;       /* scratchpad slot + 1, 0 if none */
+    int ignoreunmap;   /* UnmapNotify events caused by us */
+    Geometry *geom;    /* remembered geometry of its class, NULL if not kept */
+    Client *next;
+    Client *snext;
+    Client *wnext; /* work queue */
+    Client *rnext; /* raise order */
+    Client *transfor; /* the client it is transient for, NULL if none */
+    Client *tfirst, *tnext; /* its shown transients and their siblings, by stackorder() */
+    Window win; /* The window */
+};
+
+/* places tile i of n inside the window area, outer size including the border */
+typedef struct {
+    const char *symbol;
+    void (*tile)(Monitor *m, int n, int i, int *x, int *y, int *w, int *h);
+    Bool local; /* a tile doesn't depend on the number of tiles */
+} Layout;
+
+struct Monitor {
+    int num;
+    int mx, my, mw, mh;   /* screen size */
+    int wx, wy, ww, wh;   /* window area  */
+    const Layout *lt;
+    float mfact;          /* master area width */
+    int nmaster;
+    int ntiles;           /* tiled clients at the last arrangetiles() */
+    int tilefrom;         /* first tile to recompute, INT_MAX if none */
+    Client *clients;
+    Client *thesel;
+    Client *thestack;
+    Client *raised;       /* raise order, the last raised first */
+};
+
+/* the geometry c may have, kept on the screen when interactive and in the
+ * window area otherwise, True if it differs from the current one */
+Bool applysizehints(const Monitor *m, const Client *c, int *x, int *y, int *w, int *h,
+                    int minsize, Bool interact);
+
+/* client list, in window number order, and focus stack, the focused first */
+void attach(Monitor *m, Client *c);
+void attachend(Monitor *m, Client *c);
+void attachstack(Monitor *m, Client *c);
+void attachstackend(Monitor *m, Client *c);
+void detach(Monitor *m, Client *c);
+void detachstack(Monitor *m, Client *c);
+
+/* the client after (dir > 0) or before the focused one, wrapping around */
+Client *nextclient(const Monitor *m, int dir);
+/* the client with window number n when the first is numbered base */
+Client *nthclient(const Monitor *m, int base, unsigned int n);
+
+/* a window moved to x,y sticks to the edges of the window area within dist */
+void snaptoarea(const Monitor *m, const Client *c, int *x, int *y, int dist);
+/* moves an outer w x h rectangle at x,y into the window area, top left first */
+void clamptoarea(const Monitor *m, int w, int h, int *x, int *y);
+
+/* raise order, every client is in it from manage to unmanage */
+void raiseclient(Monitor *m, Client *c);
+void detachraise(Monitor *m, Client *c);
+/* makes c transient for t (NULL for none), False if t is transient for c */
+Bool settransient(Client *c, Client *t);
+/* the shown clients bottom to top into order, which has room for all of
+ * the raise order: by layer, the focused fullscreen client in the top one,
+ * then by raise order, with transients right above the client they are
+ * for and at least in its layer; returns how many there are and sets
+ * nbelow to how many are in the below and normal layers */
+int stackorder(Monitor *m, Client **order, int *nbelow);
+/* the part of want (bottom to top) to restack so that the windows of cur
+ * (as the server has them) end up in its order, as want[lo..hi), keeping
+ * the most windows that are in order already where they are; False if none
+ * has to move. work has room for ncur + 3 * n ints */
+Bool stackdiff(const Window *cur, int ncur, const Window *want, int n, int *lo, int *hi,
+               int *work);
+
+#endif
@@ -21,10 +21,47 @@
 /* Snap distance */
 #define SNAP 16
 
-/* Reserved space Top/Bottom of the screen */
+/* Pixels per key press when moving or resizing with the keyboard */
+#define DRAG_STEP 16
+
+/* Built-in bar at the top: window numbers, focused title and the root window
+ * name as status text (e.g. xsetroot -name "$(date)") */
+#define SHOW_BAR 0
+#define BAR_FONT "fixed"
+#define BAR_FG 0x000000
+#define BAR_BG UNFOCUS
+
+/* Show all windows while switching, hidden SWITCHER_DELAY ms after the last
+ * switch. Thumbnails need the compositor (see the Makefile), else it is a list */
+#define SWITCHER_OVERLAY 0
+#define SWITCHER_DELAY 800
+#define THUMB_WIDTH 192
+#define THUMB_HEIGHT 144
+
+/* With the compositor, a fullscreen client covering the screen is drawn by the
+ * server directly. With 0 only clients asking with _NET_WM_BYPASS_COMPOSITOR are */
+#define UNREDIRECT_FULLSCREEN 1
+
+/* Reserved space Top/Bottom of the screen, docks reserve more with their struts */
 #define TOP_SIZE 0
 #define BOTTOM_SIZE 0
 
+/* Put new floating windows that ask for no position where they overlap the least */
+#define SMART_PLACEMENT 1
+
+/* Remember the last floating geometry per WM_CLASS (and WM_WINDOW_ROLE) in
+ * ~/calavera-wm/geometry, written GEOMETRY_SAVE_DELAY ms after a change */
+#define REMEMBER_GEOMETRY 1
+#define GEOMETRY_BY_ROLE 0
+#define GEOMETRY_SAVE_DELAY 5000
+
+/* Tile new windows instead of floating them (transient and fixed size ones always float) */
+#define TILE_BY_DEFAULT 0
+
+/* Master area share of the screen width and number of windows in it */
+#define MFACT 0.55
+#define NMASTER 1
+
 /* Initial indexing windows 0= 0123456789 1= 123456789 */
 #define VIEW_NUMBER_MAP 0
 
@@ -34,6 +71,12 @@
 #define CURSOR XC_X_cursor
 #define CURSOR_WAITKEY XC_icon
 
+/* Focus follows mouse: focus a window once the pointer rested on it for
+ * HOVER_DELAY ms and moved at least HOVER_THRESHOLD pixels since the last change */
+#define FOCUS_FOLLOWS_MOUSE 0
+#define HOVER_DELAY 150
+#define HOVER_THRESHOLD 8
+
 /* Pressing a key sends the cursor to the bottom right corner */
 #define HIDE_CURSOR 0
 
@@ -44,12 +87,54 @@
 #define PREFIX_MODKEY ControlMask  /* modifier prefix */
 #define PREFIX_KEYSYM XK_t         /* prefix key */
 
+/* Leave command mode after this many milliseconds without a command key (0 = wait forever) */
+#define PREFIX_TIMEOUT 0
+
+/* Milliseconds a launch waits for its first window: runorraise() won't start it
+ * again meanwhile and the spawn to map latency is counted if it comes in time */
+#define SPAWN_TIMEOUT 10000
+
+/* Microseconds of low priority work (titles, hints, properties) run per idle slice */
+#define IDLE_BUDGET 2000
+
+/* Print statistics to stderr every STATS_INTERVAL seconds (0 = only on SIGUSR1) */
+#define STATS_INTERVAL 0
+
+/* Publish windows, focus and counters in shared memory for bars and scripts (calavera-state) */
+#define SHARED_STATE 1
+
+/* LAYOUTS, for windows that are not floating, the first one is the default */
+static const Layout layouts[] = {
+    /* symbol   tile function   tiles don't depend on their number */
+    { "[]=",    tile,           False },
+    { "###",    grid,           False },
+    { "[M]",    monocle,        True },
+};
+
 /* COMMANDS */
 static const char *CMD_TERM[]    = { "urxvt", NULL };
 static const char *CMD_BROWSER[] = { "conkeror", NULL, NULL, NULL, "Conkeror" };
 static const char *CMD_EDITOR[]  = { "emacsclient", "-c", NULL, NULL, "Emacs" };
 static const char *CMD_LOCK[]    = { "xlock", "-mode", "star", NULL };
 
+/* SCRATCHPADS, started with the WM and kept hidden until toggled, the
+ * window is recognized by the instance part of its WM_CLASS */
+static const char *CMD_SCRATCH[] = { "urxvt", "-name", "scratchpad", NULL };
+static const Scratchpad scratchpads[] = {
+    /* instance       command */
+    { "scratchpad",   CMD_SCRATCH },
+};
+
+/* RULES, all rules matching a new window apply in order. The patterns are
+ * globs (* and ?) on the class and instance of WM_CLASS, the title,
+ * WM_WINDOW_ROLE and the window type in lower case without
+ * _NET_WM_WINDOW_TYPE_ (normal, dialog...), a missing one matches anything.
+ * floating, fullscreen and focus (on map) are RuleYes or RuleNo, the
+ * geometry x, y, w, h is relative to the monitor and only used if w is set */
+static const Rule rules[] = {
+    { .class = "Gimp", .floating = RuleYes },
+};
+
 /* KEY BINDINGS */
 static Key keys[] = {
     /* modifier     key        function        argument */
@@ -62,6 +147,13 @@ static Key keys[] = {
     { None,         XK_f,      fullscreen,     {0} },
     { None,         XK_m,      maximize,       {0} },
     { None,         XK_period, center,         {0} },
+    { None,         XK_v,      movekeyboard,   {0} },
+    { None,         XK_r,      resizekeyboard, {0} },
+    { None,         XK_s,      togglescratch,  {.i = 0 } },
+    { None,         XK_space,  nextlayout,     {.i = +1 } },
+    { ShiftMask,    XK_space,  togglefloating, {0} },
+    { None,         XK_bracketleft,  setmfact, {.f = -0.05} },
+    { None,         XK_bracketright, setmfact, {.f = +0.05} },
     { None,         XK_Tab,    switcher,       {.i = +1 } },
     { ShiftMask,    XK_Tab,    switcher,       {.i = -1 } },
     { None,         XK_k,      killfocused,    {0} },
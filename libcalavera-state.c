@@ -0,0 +1,76 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Reader side of the calavera-wm state snapshot, see calavera-state.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "calavera-state.h"
+
+#define RETRIES 100000 /* reads that found the WM writing before giving up */
+
+const CalaveraState *calavera_state_open(const char *display) {
+    char name[64];
+    int fd, err;
+    struct stat st;
+    void *p;
+
+    calavera_state_name(name, sizeof name, display, getuid());
+    if((fd = shm_open(name, O_RDONLY, 0)) < 0)
+        return NULL;
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(CalaveraState)) {
+        err = errno ? errno : EPROTO;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    p = mmap(NULL, sizeof(CalaveraState), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED)
+        return NULL;
+    if(((CalaveraState *)p)->magic != CALAVERA_STATE_MAGIC
+       || ((CalaveraState *)p)->version != CALAVERA_STATE_VERSION) {
+        munmap(p, sizeof(CalaveraState));
+        errno = EPROTO;
+        return NULL;
+    }
+    return p;
+}
+
+int calavera_state_read(const CalaveraState *shm, CalaveraState *s) {
+    uint32_t seq;
+    unsigned int i, n;
+
+    for(i = 0; i < RETRIES; i++) {
+        if((seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE)) & 1)
+            continue;
+        /* the header, then only the clients it lists */
+        memcpy(s, shm, offsetof(CalaveraState, clients));
+        n = s->nclients < CALAVERA_STATE_MAXCLIENTS ? s->nclients : CALAVERA_STATE_MAXCLIENTS;
+        memcpy(s->clients, shm->clients, n * sizeof *s->clients);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+        if(s->magic != CALAVERA_STATE_MAGIC) {
+            errno = ESTALE;
+            return -1;
+        }
+        s->nclients = n;
+        return 0;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+uint32_t calavera_state_seq(const CalaveraState *shm) {
+    return __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+}
+
+void calavera_state_close(const CalaveraState *shm) {
+    if(shm)
+        munmap((void *)shm, sizeof(CalaveraState));
+}
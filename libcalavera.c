@@ -0,0 +1,290 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Core of calavera-wm, see calavera.h. Nothing here talks to the X server
+ * or touches the WM's globals, everything it works on is passed in.
+ */
+
+#include <stdlib.h>
+
+#include "calavera.h"
+
+Bool applysizehints(const Monitor *m, const Client *c, int *x, int *y, int *w, int *h,
+                    int minsize, Bool interact) {
+    Bool baseismin;
+
+    /* set minimum possible */
+    *w = MAX(1, *w);
+    *h = MAX(1, *h);
+    if(interact) {
+        if(*x > m->mx + m->mw)
+            *x = m->mx + m->mw - WIDTH(c);
+        if(*y > m->my + m->mh)
+            *y = m->my + m->mh - HEIGHT(c);
+        if(*x + *w + 2 * c->bw < m->mx)
+            *x = m->mx;
+        if(*y + *h + 2 * c->bw < m->my)
+            *y = m->my;
+    }
+    else {
+        if(*x >= m->wx + m->ww)
+            *x = m->wx + m->ww - WIDTH(c);
+        if(*y >= m->wy + m->wh)
+            *y = m->wy + m->wh - HEIGHT(c);
+        if(*x + *w + 2 * c->bw <= m->wx)
+            *x = m->wx;
+        if(*y + *h + 2 * c->bw <= m->wy)
+            *y = m->wy;
+    }
+    if(*h < minsize)
+        *h = minsize;
+    if(*w < minsize)
+        *w = minsize;
+    if(c->isfloating) {
+        /* see last two sentences in ICCCM 4.1.2.3 */
+        baseismin = c->basew == c->minw && c->baseh == c->minh;
+        if(!baseismin) { /* temporarily remove base dimensions */
+            *w -= c->basew;
+            *h -= c->baseh;
+        }
+        /* adjust for aspect limits */
+        if(c->mina > 0 && c->maxa > 0) {
+            if(c->maxa < (float)*w / *h)
+                *w = *h * c->maxa + 0.5;
+            else if(c->mina < (float)*h / *w)
+                *h = *w * c->mina + 0.5;
+        }
+        if(baseismin) { /* increment calculation requires this */
+            *w -= c->basew;
+            *h -= c->baseh;
+        }
+        /* adjust for increment value */
+        if(c->incw)
+            *w -= *w % c->incw;
+        if(c->inch)
+            *h -= *h % c->inch;
+        /* restore base dimensions */
+        *w = MAX(*w + c->basew, c->minw);
+        *h = MAX(*h + c->baseh, c->minh);
+        if(c->maxw)
+            *w = MIN(*w, c->maxw);
+        if(c->maxh)
+            *h = MIN(*h, c->maxh);
+    }
+    return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
+}
+
+void attach(Monitor *m, Client *c) {
+    c->next = m->clients;
+    m->clients = c;
+}
+
+void attachend(Monitor *m, Client *c) {
+    Client **tc;
+
+    for(tc = &m->clients; *tc; tc = &(*tc)->next);
+    c->next = NULL;
+    *tc = c;
+}
+
+void attachstack(Monitor *m, Client *c) {
+    c->snext = m->thestack;
+    m->thestack = c;
+}
+
+void attachstackend(Monitor *m, Client *c) {
+    Client **tc;
+
+    for(tc = &m->thestack; *tc; tc = &(*tc)->snext);
+    c->snext = NULL;
+    *tc = c;
+}
+
+void detach(Monitor *m, Client *c) {
+    Client **tc;
+
+    for(tc = &m->clients; *tc && *tc != c; tc = &(*tc)->next);
+    *tc = c->next;
+}
+
+void detachstack(Monitor *m, Client *c) {
+    Client **tc;
+
+    for(tc = &m->thestack; *tc && *tc != c; tc = &(*tc)->snext);
+    *tc = c->snext;
+}
+
+Client *nextclient(const Monitor *m, int dir) {
+    Client *c = NULL, *i;
+
+    if(!m->thesel)
+        return NULL;
+    if(dir > 0)
+        return m->thesel->next ? m->thesel->next : m->clients;
+    for(i = m->clients; i != m->thesel; i = i->next)
+        c = i;
+    if(!c) /* the first one, go to the last */
+        for(; i; i = i->next)
+            c = i;
+    return c;
+}
+
+Client *nthclient(const Monitor *m, int base, unsigned int n) {
+    Client *c;
+    int i;
+
+    for(c = m->clients, i = base; c && i < (int)n; c = c->next, i++);
+    return c;
+}
+
+void snaptoarea(const Monitor *m, const Client *c, int *x, int *y, int dist) {
+    /* only while the corner is in the area, dragging out of it stays free */
+    if(*x < m->wx || *x > m->wx + m->ww || *y < m->wy || *y > m->wy + m->wh)
+        return;
+    if(abs(m->wx - *x) < dist)
+        *x = m->wx;
+    else if(abs((m->wx + m->ww) - (*x + WIDTH(c))) < dist)
+        *x = m->wx + m->ww - WIDTH(c);
+    if(abs(m->wy - *y) < dist)
+        *y = m->wy;
+    else if(abs((m->wy + m->wh) - (*y + HEIGHT(c))) < dist)
+        *y = m->wy + m->wh - HEIGHT(c);
+}
+
+void clamptoarea(const Monitor *m, int w, int h, int *x, int *y) {
+    *x = MAX(m->wx, MIN(*x, m->wx + m->ww - w));
+    *y = MAX(m->wy, MIN(*y, m->wy + m->wh - h));
+}
+
+void raiseclient(Monitor *m, Client *c) {
+    /* the clients it is transient for come up with it, right below */
+    if(c->transfor)
+        raiseclient(m, c->transfor);
+    detachraise(m, c);
+    c->rnext = m->raised;
+    m->raised = c;
+}
+
+void detachraise(Monitor *m, Client *c) {
+    Client **tc;
+
+    for(tc = &m->raised; *tc && *tc != c; tc = &(*tc)->rnext);
+    if(*tc)
+        *tc = c->rnext;
+}
+
+Bool settransient(Client *c, Client *t) {
+    Client *p;
+
+    for(p = t; p; p = p->transfor)
+        if(p == c)
+            return False;
+    c->transfor = t;
+    return True;
+}
+
+static int ownlayer(const Monitor *m, const Client *c) {
+    /* only while it or one of its dialogs has the focus, the docks are back otherwise */
+    if(c->isfullscreen && m->thesel && (m->thesel == c || m->thesel->transfor == c))
+        return LayerFullscreen;
+    return c->isabove ? LayerAbove : c->isbelow ? LayerBelow : LayerNormal;
+}
+
+/* the clients of list into order bottom to top, each right below its transients */
+static int stackgroup(Client *list, Client **order, int n) {
+    Client *c;
+
+    for(c = list; c; c = c->tnext) {
+        order[n++] = c;
+        n = stackgroup(c->tfirst, order, n);
+    }
+    return n;
+}
+
+int stackorder(Monitor *m, Client **order, int *nbelow) {
+    Client *c, *t, *roots[LayerLast] = { NULL };
+    int l, n = 0;
+
+    for(c = m->raised; c; c = c->rnext) {
+        for(c->layer = ownlayer(m, c), t = c->transfor; t; t = t->transfor)
+            c->layer = MAX(c->layer, ownlayer(m, t));
+        c->tfirst = NULL;
+    }
+    /* prepending from the top leaves each list bottom first; a transient
+     * goes with the client it is for unless that is hidden or in a lower
+     * layer, then it is stacked on its own */
+    for(c = m->raised; c; c = c->rnext) {
+        if(c->ishidden)
+            continue;
+        if(c->transfor && !c->transfor->ishidden && c->transfor->layer == c->layer) {
+            c->tnext = c->transfor->tfirst;
+            c->transfor->tfirst = c;
+        }
+        else {
+            c->tnext = roots[c->layer];
+            roots[c->layer] = c;
+        }
+    }
+    *nbelow = 0;
+    for(l = LayerBelow; l < LayerLast; l++) {
+        if(l == LayerAbove)
+            *nbelow = n;
+        n = stackgroup(roots[l], order, n);
+    }
+    return n;
+}
+
+/* idx sorted by win[idx], a shell sort as qsort() can't be passed win */
+static void sortbywin(const Window *win, int *idx, int n) {
+    static const int gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+    unsigned int g;
+    int i, j, k, v;
+
+    for(g = 0; g < sizeof gaps / sizeof gaps[0]; g++)
+        for(k = gaps[g], i = k; i < n; i++) {
+            for(v = idx[i], j = i; j >= k && win[idx[j - k]] > win[v]; j -= k)
+                idx[j] = idx[j - k];
+            idx[j] = v;
+        }
+}
+
+Bool stackdiff(const Window *cur, int ncur, const Window *want, int n, int *lo, int *hi,
+               int *work) {
+    int *byid = work, *pos = work + ncur, *tails = pos + n, *prev = tails + n;
+    int i, a, b, mid, len = 0;
+
+    for(i = 0; i < ncur; i++)
+        byid[i] = i;
+    sortbywin(cur, byid, ncur);
+    /* where the server has each window, -1 if not among cur */
+    for(i = 0; i < n; i++) {
+        for(a = 0, b = ncur; a < b; ) {
+            mid = (a + b) / 2;
+            if(cur[byid[mid]] < want[i])
+                a = mid + 1;
+            else
+                b = mid;
+        }
+        pos[i] = a < ncur && cur[byid[a]] == want[i] ? byid[a] : -1;
+    }
+    /* the longest subsequence of windows in the server's order stays */
+    for(i = 0; i < n; i++) {
+        if(pos[i] < 0)
+            continue;
+        for(a = 0, b = len; a < b; ) {
+            mid = (a + b) / 2;
+            if(pos[tails[mid]] < pos[i])
+                a = mid + 1;
+            else
+                b = mid;
+        }
+        prev[i] = a ? tails[a - 1] : -1;
+        tails[a] = i;
+        if(a == len)
+            len++;
+    }
+    for(i = len ? tails[len - 1] : -1; i >= 0; i = prev[i])
+        pos[i] = -2;
+    for(*lo = 0; *lo < n && pos[*lo] == -2; (*lo)++);
+    for(*hi = n; *hi > *lo && pos[*hi - 1] == -2; (*hi)--);
+    return *lo < *hi;
+}
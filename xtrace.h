@@ -0,0 +1,165 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * X round trip tracer for debug builds (make xtrace).
+ *
+ * Blocking Xlib calls are wrapped to count round trips and NextRequest() is
+ * sampled to count requests. Both are attributed to every XTRACE_SCOPE()
+ * active at the time, so a scope reports what it caused including its
+ * callees, e.g. "manage(): 3 round trips, 11 requests".
+ *
+ * Scopes can declare a round trip budget per call, either below or with
+ * CALAVERA_XTRACE_BUDGET="unmanage()=3,manage()=6". With
+ * CALAVERA_XTRACE_STRICT set, exceeding a budget prints the report and exits
+ * with a failure.
+ */
+
+#ifndef XTRACE_H
+#define XTRACE_H
+
+#define XTRACE_MAXRECORDS 64
+
+typedef struct {
+    const char *name;
+    unsigned long calls, requests, roundtrips;
+    unsigned long maxrequests, maxroundtrips;
+    long budget; /* round trips per call, -1 if unlimited */
+} XTraceRecord;
+
+typedef struct {
+    XTraceRecord *rec;
+    unsigned long request, roundtrips;
+} XTraceScope;
+
+static XTraceRecord xtrace_records[XTRACE_MAXRECORDS];
+static unsigned int xtrace_nrecords;
+static unsigned long xtrace_roundtrips;
+static Display *xtrace_display;
+
+/* default budgets, round trips per call */
+static const struct {
+    const char *name;
+    long budget;
+} xtrace_budgets[] = {
+    { "focus()",            0 }, /* commit() applies it */
+    { "switcher()",         3 },
+    { "manage()",           10 },
+    { "unmanage()",         4 },
+    { "configurerequest()", 2 },
+};
+
+static const char *xtrace_events[LASTEvent] = {
+    [ButtonPress] = "buttonpress()",
+    [ButtonRelease] = "buttonrelease()",
+    [ClientMessage] = "clientmessage()",
+    [ConfigureRequest] = "configurerequest()",
+    [ConfigureNotify] = "configurenotify()",
+    [DestroyNotify] = "destroynotify()",
+    [EnterNotify] = "enternotify()",
+    [Expose] = "expose()",
+    [FocusIn] = "focusin()",
+    [KeyPress] = "keypress()",
+    [MappingNotify] = "mappingnotify()",
+    [MapRequest] = "maprequest()",
+    [MotionNotify] = "motionnotify()",
+    [PropertyNotify] = "propertynotify()",
+    [UnmapNotify] = "unmapnotify()",
+};
+
+static long xtrace_budget(const char *name) {
+    char *env, *p, *eq;
+    size_t len = strlen(name);
+    unsigned int i;
+
+    if((env = getenv("CALAVERA_XTRACE_BUDGET")))
+        for(p = env; (p = strstr(p, name)); p += len)
+            if((p == env || p[-1] == ',') && *(eq = p + len) == '=')
+                return strtol(eq + 1, NULL, 10);
+    for(i = 0; i < LENGTH(xtrace_budgets); i++)
+        if(!strcmp(xtrace_budgets[i].name, name))
+            return xtrace_budgets[i].budget;
+    return -1;
+}
+
+static void xtrace_report(FILE *f) {
+    unsigned int i;
+    XTraceRecord *r;
+
+    for(i = 0; i < xtrace_nrecords; i++) {
+        r = &xtrace_records[i];
+        fprintf(f, "calavera-wm: %s: %lu calls, %.1f round trips, %.1f requests"
+                " per call (max %lu round trips, %lu requests)\n",
+                r->name, r->calls, (double)r->roundtrips / r->calls,
+                (double)r->requests / r->calls, r->maxroundtrips, r->maxrequests);
+    }
+}
+
+static XTraceScope xtrace_enter(Display *dpy, const char *name) {
+    unsigned int i;
+    XTraceScope s = { NULL, 0, 0 };
+
+    if(!name)
+        return s;
+    xtrace_display = dpy;
+    /* names are string literals, compare pointers first */
+    for(i = 0; i < xtrace_nrecords && xtrace_records[i].name != name
+        && strcmp(xtrace_records[i].name, name); i++);
+    if(i == xtrace_nrecords) {
+        if(i == XTRACE_MAXRECORDS)
+            return s;
+        xtrace_records[i].name = name;
+        xtrace_records[i].budget = xtrace_budget(name);
+        xtrace_nrecords++;
+    }
+    s.rec = &xtrace_records[i];
+    s.request = NextRequest(dpy);
+    s.roundtrips = xtrace_roundtrips;
+    return s;
+}
+
+static void xtrace_leave(XTraceScope *s) {
+    unsigned long requests, roundtrips;
+    XTraceRecord *r = s->rec;
+
+    if(!r)
+        return;
+    requests = NextRequest(xtrace_display) - s->request;
+    roundtrips = xtrace_roundtrips - s->roundtrips;
+    r->calls++;
+    r->requests += requests;
+    r->roundtrips += roundtrips;
+    r->maxrequests = MAX(r->maxrequests, requests);
+    r->maxroundtrips = MAX(r->maxroundtrips, roundtrips);
+    if(r->budget >= 0 && roundtrips > (unsigned long)r->budget) {
+        fprintf(stderr, "calavera-wm: %s: %lu round trips, budget is %ld\n",
+                r->name, roundtrips, r->budget);
+        if(getenv("CALAVERA_XTRACE_STRICT")) {
+            xtrace_report(stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+#define XTRACE_SCOPE(name) \
+    XTraceScope xtrace_scope __attribute__((cleanup(xtrace_leave))) = xtrace_enter(display, name)
+#define XTRACE_EVENT(type) XTRACE_SCOPE(xtrace_events[type])
+#define XTRACE_REPORT() xtrace_report(stderr)
+
+/* calls that wait for a reply */
+#define XGetAtomName(...)           (xtrace_roundtrips++, XGetAtomName(__VA_ARGS__))
+#define XGetClassHint(...)          (xtrace_roundtrips++, XGetClassHint(__VA_ARGS__))
+#define XGetGeometry(...)           (xtrace_roundtrips++, XGetGeometry(__VA_ARGS__))
+#define XGetModifierMapping(...)    (xtrace_roundtrips++, XGetModifierMapping(__VA_ARGS__))
+#define XGetTextProperty(...)       (xtrace_roundtrips++, XGetTextProperty(__VA_ARGS__))
+#define XGetTransientForHint(...)   (xtrace_roundtrips++, XGetTransientForHint(__VA_ARGS__))
+#define XGetWMNormalHints(...)      (xtrace_roundtrips++, XGetWMNormalHints(__VA_ARGS__))
+#define XGetWMProtocols(...)        (xtrace_roundtrips++, XGetWMProtocols(__VA_ARGS__))
+#define XGetWindowAttributes(...)   (xtrace_roundtrips++, XGetWindowAttributes(__VA_ARGS__))
+#define XGetWindowProperty(...)     (xtrace_roundtrips++, XGetWindowProperty(__VA_ARGS__))
+#define XGrabKeyboard(...)          (xtrace_roundtrips++, XGrabKeyboard(__VA_ARGS__))
+#define XGrabPointer(...)           (xtrace_roundtrips++, XGrabPointer(__VA_ARGS__))
+#define XInternAtom(...)            (xtrace_roundtrips++, XInternAtom(__VA_ARGS__))
+#define XQueryPointer(...)          (xtrace_roundtrips++, XQueryPointer(__VA_ARGS__))
+#define XQueryTree(...)             (xtrace_roundtrips++, XQueryTree(__VA_ARGS__))
+#define XSync(...)                  (xtrace_roundtrips++, XSync(__VA_ARGS__))
+
+#endif